@@ -0,0 +1,416 @@
+// Checks that need no window, run by ctest or directly. GL calls go to MockGlBackend. Prints one line per check and exits with 1 if any failed.
+//
+// Usage: checks
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "event_bus.h"
+#include "events.h"
+#include "gl_state.h"
+#include "profile_picker.h"
+#include "revolve.h"
+#include "self_intersection.h"
+#include "slicer.h"
+#include "vase_editor.h"
+
+static int g_failed = 0;
+
+static void Check (bool ok, std::string const& what)
+{
+    std::printf("%-6s %s\n", ok ? "ok" : "FAILED", what.c_str());
+    if(!ok)
+        ++g_failed;
+}
+
+// Revolving a 5000 point profile gives a million triangles, which have to be checked within a second.
+static void CheckSelfIntersectionTiming ()
+{
+    const int kRows = 5000;
+    std::vector<glm::vec3> axis_pos{{0, -1, 0}, {0, 1, 0}};
+    for(int crossing = 0; crossing < 2; ++crossing)
+    {
+        // An ellipse next to the axis, or one that reaches across it.
+        float center = crossing ? 0.1f : 0.5f;
+        std::vector<glm::vec3> profile;
+        for(int i = 0; i < kRows; ++i)
+        {
+            double t = 2 * M_PI * i / kRows;
+            profile.push_back(glm::vec3(float(center + 0.2 * std::cos(t)), float(0.5 * std::sin(t)), 0.0f));
+        }
+        std::vector<glm::vec3> mesh_pos;
+        std::vector<unsigned> mesh_inds;
+        RevolveProfile(profile, axis_pos, kRevolveIncrements, &mesh_pos, &mesh_inds);
+
+        auto start = std::chrono::steady_clock::now();
+        auto report = SelfIntersectionChecker().Check(mesh_pos, mesh_inds, kRevolveIncrements);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        char what[128];
+        std::snprintf(what, sizeof(what), "self intersection check of %zu triangles %s the axis: %.0f ms, %zu pairs",
+                      mesh_inds.size() / 3, crossing ? "crossing" : "next to", ms, report.pairs.size());
+        Check(ms < 1000 && report.Empty() != bool(crossing), what);
+    }
+}
+
+// Distance along a ray to triangle (a, b, c), or -1 if the ray misses it.
+static float RayTriangle (Ray const& ray, glm::vec3 const& a, glm::vec3 const& b, glm::vec3 const& c)
+{
+    glm::vec3 e1 = b - a, e2 = c - a, p = glm::cross(ray.dir, e2);
+    float det = glm::dot(e1, p);
+    if(std::fabs(det) < 1e-12f)
+        return -1;
+    glm::vec3 to_origin = ray.origin - a, q = glm::cross(to_origin, e1);
+    float u = glm::dot(to_origin, p) / det, v = glm::dot(ray.dir, q) / det;
+    if(u < 0 || v < 0 || u + v > 1)
+        return -1;
+    float s = glm::dot(e2, q) / det;
+    return s > 0 ? s : -1;
+}
+
+// Picks have to hit the rows of the generated solid that a ray against every triangle hits, for an axis longer than
+// the profile, one shorter than it, whose rows past the ends are tilted, and a bent one.
+static void CheckPickAgainstTriangles ()
+{
+    const int kRows = 60, kRays = 1000;
+    std::vector<glm::vec3> profile;
+    for(int i = 0; i < kRows; ++i)
+    {
+        double t = 2 * M_PI * i / kRows;
+        profile.push_back(glm::vec3(float(0.15 + 0.05 * std::cos(t) + 0.03 * std::sin(3 * t)), float(0.5 * std::sin(t)), 0.0f));
+    }
+    std::vector<std::pair<char const*, std::vector<glm::vec3>>> axes{
+        {"long", {{0, -1, 0}, {0, 1, 0}}}, {"short", {{0, -0.2f, 0}, {0, 0.2f, 0}}},
+        {"bent", {{0, -1, 0}, {0.1f, 0, 0}, {0, 1, 0}}}};
+
+    for(auto const& axis: axes)
+    {
+        std::vector<glm::vec3> mesh_pos;
+        std::vector<unsigned> mesh_inds;
+        RevolveProfile(profile, axis.second, kRevolveIncrements, &mesh_pos, &mesh_inds);
+        ProfilePicker picker;
+        picker.Build(profile, axis.second);
+
+        // Rays from in front of the solid towards points around it, so some graze or miss it.
+        unsigned seed = 1;
+        auto random = [&seed]() {seed = seed * 1103515245u + 12345u; return float((seed >> 8) & 0xffff) / 0x8000 - 1;};
+        int agree = 0;
+        for(int i = 0; i < kRays; ++i)
+        {
+            glm::vec3 origin(0.2f * random(), 0.8f * random(), 3.0f);
+            glm::vec3 target(0.7f * random(), 0.6f * random(), 0.7f * random());
+            Ray ray{origin, glm::normalize(target - origin)};
+
+            float nearest = FLT_MAX;
+            size_t hit = 0;
+            for(size_t k = 0; k < mesh_inds.size(); k += 3)
+            {
+                float s = RayTriangle(ray, mesh_pos[mesh_inds[k]], mesh_pos[mesh_inds[k + 1]], mesh_pos[mesh_inds[k + 2]]);
+                if(s >= 0 && s < nearest)
+                {
+                    nearest = s;
+                    hit = k;
+                }
+            }
+            ProfileHit pick = picker.Pick(ray);
+            if(nearest == FLT_MAX || !pick.hit)
+            {
+                agree += nearest == FLT_MAX && !pick.hit;
+                continue;
+            }
+            for(size_t v = hit; v < hit + 3; ++v)
+                if(pick.row == int(mesh_inds[v] / kRevolveIncrements))
+                {
+                    ++agree;
+                    break;
+                }
+        }
+
+        char what[128];
+        std::snprintf(what, sizeof(what), "picks on a %s axis: %d of %d rays hit or miss the same row as against every triangle",
+                      axis.first, agree, kRays);
+        Check(agree >= kRays * 98 / 100, what);
+    }
+}
+
+// Distance from p to the segment from a to b.
+static float SegmentDistance (glm::vec2 p, glm::vec2 a, glm::vec2 b)
+{
+    glm::vec2 e = b - a;
+    float len2 = glm::dot(e, e);
+    float f = len2 > 0 ? std::max(0.0f, std::min(1.0f, glm::dot(p - a, e) / len2)) : 0;
+    return glm::distance(p, a + f * e);
+}
+
+// The layers the slicer cuts straight from the profile have to lie on the plane cuts of the mesh RevolveProfile builds
+// at the same angular resolution, and cover all of them, for an axis longer than the profile and one shorter than
+// it, whose rows past the ends are tilted.
+static void CheckSliceAgainstMesh ()
+{
+    const int kRows = 60;
+    std::vector<glm::vec3> profile;
+    for(int i = 0; i < kRows; ++i)
+    {
+        double t = 2 * M_PI * i / kRows;
+        profile.push_back(glm::vec3(float(0.15 + 0.05 * std::cos(t) + 0.03 * std::sin(3 * t)), float(0.5 * std::sin(t)), 0.0f));
+    }
+    std::vector<std::pair<char const*, std::vector<glm::vec3>>> axes{
+        {"long", {{0, -1, 0}, {0, 1, 0}}}, {"short", {{0, -0.2f, 0}, {0, 0.2f, 0}}}};
+
+    SliceSettings settings;
+    settings.scale = 1;
+    settings.layer_height = 0.05f;
+    settings.n_incs = kRevolveIncrements;
+    for(auto const& axis: axes)
+    {
+        std::vector<glm::vec3> mesh_pos;
+        std::vector<unsigned> mesh_inds;
+        RevolveProfile(profile, axis.second, kRevolveIncrements, &mesh_pos, &mesh_inds);
+        auto layers = LayerSlicer(profile, axis.second).Slice(settings);
+
+        // Mesh vertices as (height along the axis, offset along its normal, z), like the slicer's.
+        glm::vec3 origin = axis.second.front(), dir = glm::normalize(axis.second.back() - origin);
+        glm::vec3 normal(-dir.y, dir.x, 0);
+        std::vector<glm::vec3> local;
+        for(auto const& p: mesh_pos)
+            local.push_back(glm::vec3(glm::dot(p - origin, dir), glm::dot(p - origin, normal), p.z));
+
+        float off_mesh = 0, uncovered = 0;
+        size_t n_contours = 0;
+        for(auto const& layer: layers)
+        {
+            std::vector<std::pair<glm::vec2, glm::vec2>> cut;
+            for(size_t k = 0; k < mesh_inds.size(); k += 3)
+            {
+                glm::vec2 ends[2];
+                int n_ends = 0;
+                for(int e = 0; e < 3; ++e)
+                {
+                    glm::vec3 a = local[mesh_inds[k + e]], b = local[mesh_inds[k + (e + 1) % 3]];
+                    if((a.x >= layer.h) == (b.x >= layer.h) || n_ends == 2)
+                        continue;
+                    float f = (layer.h - a.x) / (b.x - a.x);
+                    ends[n_ends++] = glm::vec2(a.y + f * (b.y - a.y), a.z + f * (b.z - a.z));
+                }
+                if(n_ends == 2)
+                    cut.push_back(std::make_pair(ends[0], ends[1]));
+            }
+
+            n_contours += layer.contours.size();
+            for(auto const& contour: layer.contours)
+            {
+                for(auto const& p: contour)
+                {
+                    float nearest = FLT_MAX;
+                    for(auto const& segment: cut)
+                        nearest = std::min(nearest, SegmentDistance(p, segment.first, segment.second));
+                    off_mesh = std::max(off_mesh, nearest);
+                }
+            }
+            for(auto const& segment: cut)
+            {
+                float nearest = FLT_MAX;
+                for(auto const& contour: layer.contours)
+                    for(size_t i = 0; i < contour.size(); ++i)
+                        nearest = std::min(nearest, SegmentDistance(segment.first, contour[i], contour[(i + 1) % contour.size()]));
+                uncovered = std::max(uncovered, nearest);
+            }
+        }
+
+        char what[160];
+        std::snprintf(what, sizeof(what), "slicing along a %s axis: %zu layers, %zu contours, %.2g off the mesh cut, %.2g of it uncovered",
+                      axis.first, layers.size(), n_contours, off_mesh, uncovered);
+        Check(!layers.empty() && off_mesh < 1e-4f && uncovered < 2e-3f, what);
+    }
+}
+
+// Appending to a profile and moving one of its points, then updating the solid, the picker and the self intersection
+// check from the rows that changed, gives the same result as starting over.
+static void CheckIncrementalUpdate ()
+{
+    const int kRows = 400;
+    std::vector<glm::vec3> axis_pos{{0, -1, 0}, {0, 1, 0}};
+    std::vector<glm::vec3> profile;
+    for(int i = 0; i < kRows; ++i)
+    {
+        double t = 2 * M_PI * i / kRows;
+        profile.push_back(glm::vec3(float(0.3 + 0.2 * std::cos(t)), float(0.5 * std::sin(t)), 0.0f));
+    }
+
+    ProfileRevolver revolver;
+    ProfilePicker picker, rebuilt;
+    SelfIntersectionChecker checker;
+    RevolveUpdate update;
+    std::vector<glm::vec3> mesh_pos;
+    std::vector<unsigned> mesh_inds;
+    revolver.Revolve(std::vector<glm::vec3>(profile.begin(), profile.end() - 50), axis_pos, kRevolveIncrements, &update);
+    RevolveProfile(std::vector<glm::vec3>(profile.begin(), profile.end() - 50), axis_pos, kRevolveIncrements, &mesh_pos, &mesh_inds);
+    checker.Check(mesh_pos, mesh_inds, kRevolveIncrements);
+    picker.Build(std::vector<glm::vec3>(profile.begin(), profile.end() - 50), axis_pos);
+
+    // Pull a point across the axis, so the solid intersects itself.
+    profile[100].x = -0.4f;
+    revolver.Revolve(profile, axis_pos, kRevolveIncrements, &update);
+    RevolveProfile(profile, axis_pos, kRevolveIncrements, &mesh_pos, &mesh_inds);
+    size_t row_tris = 2 * kRevolveIncrements;
+    for(auto const& range: update.ranges)
+        checker.Invalidate(range.first > 0 ? (range.first - 1) * row_tris : 0, range.end * row_tris);
+    checker.Invalidate(update.first_index_row * row_tris, kRows * row_tris);
+    auto incremental = checker.Check(mesh_pos, mesh_inds, kRevolveIncrements);
+    auto full = SelfIntersectionChecker().Check(mesh_pos, mesh_inds, kRevolveIncrements);
+    picker.Update(profile, axis_pos, kRevolveIncrements, update.first_moved);
+    rebuilt.Build(profile, axis_pos);
+
+    // Rays from around the solid towards the axis.
+    int picks_differ = 0;
+    for(int i = 0; i < 200; ++i)
+    {
+        double angle = 0.1 * i;
+        Ray ray{glm::vec3(float(3 * std::cos(angle)), float(-0.6 + 0.006 * i), float(3 * std::sin(angle))),
+                glm::normalize(glm::vec3(float(-std::cos(angle)), 0.05f, float(-std::sin(angle))))};
+        ProfileHit a = picker.Pick(ray), b = rebuilt.Pick(ray);
+        if(a.hit != b.hit || a.row != b.row || a.angle != b.angle)
+            ++picks_differ;
+    }
+
+    char what[160];
+    std::snprintf(what, sizeof(what), "incremental update: %zu of %d rows recomputed, %zu intersecting pairs and %d of 200 picks differ from scratch",
+                  update.positions.size() / kRevolveIncrements, kRows, full.pairs.size(), picks_differ);
+    bool same = incremental.pairs.size() == full.pairs.size() && incremental.rows == full.rows && !full.Empty() &&
+                picks_differ == 0;
+    Check(same && update.ranges.size() == 3 && update.first_moved == 100 && update.first_index_row == kRows - 51, what);
+}
+
+// Undoing the axis drops the solid, redoing it has to bring the solid back as it was.
+static void CheckUndoRedoSolid ()
+{
+    EventBus::CreateSingleton();
+    GlState::CreateSingleton(std::unique_ptr<GlBackend>(new MockGlBackend));
+    VaseEditor editor;
+    auto publish = [](Event* e, size_t eid) {EventBus::Publish(std::shared_ptr<Event>(e), eid);};
+    auto click = [&](float x, float y)
+    {
+        LeftClickEvent* e = new LeftClickEvent;
+        e->wpos = glm::vec2(x, y);
+        publish(e, EventBus::GetID<LeftClickEvent>());
+    };
+    for(int i = 0; i < 150; ++i)
+    {
+        double t = 2 * M_PI * i / 150;
+        click(float(0.5 + 0.2 * std::cos(t)), float(0.5 * std::sin(t)));
+    }
+    publish(new StrokeEndEvent, EventBus::GetID<StrokeEndEvent>());
+    publish(new KButtonEvent, EventBus::GetID<KButtonEvent>());
+    click(0, -0.8f);
+    click(0, 0.8f);
+    publish(new StrokeEndEvent, EventBus::GetID<StrokeEndEvent>());
+    publish(new RButtonEvent, EventBus::GetID<RButtonEvent>());
+    publish(new UndoEvent, EventBus::GetID<UndoEvent>());
+    bool dropped = editor.mesh.Empty();
+    publish(new RedoEvent, EventBus::GetID<RedoEvent>());
+
+    std::vector<glm::vec3> mesh_pos, fetched;
+    std::vector<unsigned> mesh_inds, fetched_inds;
+    RevolveProfile(editor.curve.GetPositions(), editor.axis.GetPositions(), kRevolveIncrements, &mesh_pos, &mesh_inds);
+    auto const& positions = editor.mesh.Positions(&fetched);
+    bool same = editor.mesh.Indices(&fetched_inds) == mesh_inds && positions.size() * 3 == mesh_pos.size() &&
+                std::equal(positions.begin(), positions.end(), mesh_pos.begin());
+
+    char what[128];
+    std::snprintf(what, sizeof(what), "undo and redo of the axis: %zu of %zu vertices after redo",
+                  positions.size(), mesh_pos.size() / 3);
+    Check(dropped && same, what);
+}
+
+// Per frame uniforms of the GL session below.
+struct SessionUniforms
+{
+    glm::mat4 mvp;
+};
+
+// Draw a profile and an axis, revolve, look at the solid, undo and redo, rendering every frame like custom does, all
+// through MockGlBackend. Returns the number of GL calls that reached the backend.
+static size_t RunGlSession (bool caching, GlState::Stats* stats)
+{
+    EventBus::CreateSingleton();
+    MockGlBackend* backend = new MockGlBackend;
+    GlState::CreateSingleton(std::unique_ptr<GlBackend>(backend));
+    GlState::SetCaching(caching);
+    {
+        VaseEditor editor;
+        UniformBlock<SessionUniforms> frame_block{0};
+        const GLuint kProgram = 1;
+        auto publish = [](Event* e, size_t eid) {EventBus::Publish(std::shared_ptr<Event>(e), eid);};
+        auto click = [&](float x, float y)
+        {
+            LeftClickEvent* e = new LeftClickEvent;
+            e->wpos = glm::vec2(x, y);
+            publish(e, EventBus::GetID<LeftClickEvent>());
+        };
+        auto frame = [&]()
+        {
+            SessionUniforms uniforms;
+            uniforms.mvp = editor.rotate ? glm::mat4(2.0f) : glm::mat4(1.0f);
+            GlState::UseProgram(kProgram);
+            frame_block.Set(uniforms);
+            GlState::Uniform("tex", 0);
+            editor.curve.Render();
+            editor.axis.Render();
+            editor.mesh.Render();
+        };
+
+        for(int i = 0; i < 200; ++i)
+        {
+            double t = 2 * M_PI * i / 200;
+            click(float(0.5 + 0.2 * std::cos(t)), float(0.5 * std::sin(t)));
+            frame();
+        }
+        publish(new StrokeEndEvent, EventBus::GetID<StrokeEndEvent>());
+        publish(new KButtonEvent, EventBus::GetID<KButtonEvent>());
+        click(0, -0.8f);
+        click(0, 0.8f);
+        publish(new StrokeEndEvent, EventBus::GetID<StrokeEndEvent>());
+        publish(new KButtonEvent, EventBus::GetID<KButtonEvent>());
+        publish(new RButtonEvent, EventBus::GetID<RButtonEvent>());
+        publish(new PButtonEvent, EventBus::GetID<PButtonEvent>());
+        for(int i = 0; i < 100; ++i)
+            frame();
+        publish(new UndoEvent, EventBus::GetID<UndoEvent>());
+        frame();
+        publish(new RedoEvent, EventBus::GetID<RedoEvent>());
+        for(int i = 0; i < 50; ++i)
+            frame();
+    }
+    *stats = GlState::GetStats();
+    return backend->Total();
+}
+
+// The GL state cache has to save calls on a typical session.
+static void CheckGlCallReduction ()
+{
+    GlState::Stats uncached_stats, cached_stats;
+    size_t uncached = RunGlSession(false, &uncached_stats);
+    size_t cached = RunGlSession(true, &cached_stats);
+    size_t elided = 0;
+    for(int i = 0; i < GlState::kCallTypeNum; ++i)
+        elided += cached_stats.elided[i];
+
+    char what[128];
+    std::snprintf(what, sizeof(what), "GL state cache: %zu GL calls instead of %zu, %zu elided", cached, uncached, elided);
+    Check(cached < uncached, what);
+}
+
+int main ()
+{
+    CheckSelfIntersectionTiming();
+    CheckPickAgainstTriangles();
+    CheckSliceAgainstMesh();
+    CheckIncrementalUpdate();
+    CheckUndoRedoSolid();
+    CheckGlCallReduction();
+    return g_failed > 0 ? 1 : 0;
+}
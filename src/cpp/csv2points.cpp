@@ -0,0 +1,27 @@
+// Converts a profile, and optionally an axis, from CSV files with one "x,y" point per line to a point file that
+// `custom --load <file>` and `replay --load <file>` map into memory.
+//
+// Usage: csv2points <profile.csv> [axis.csv] <out>
+
+#include <iostream>
+#include <string>
+#include "point_file.h"
+
+int main(int argc, char** argv)
+{
+    if(argc != 3 && argc != 4)
+    {
+        std::cerr << "Usage: " << argv[0] << " <profile.csv> [axis.csv] <out>" << std::endl;
+        return 1;
+    }
+    std::string axis_csv = argc == 4 ? argv[2] : "";
+    std::string out_path = argv[argc - 1];
+    if(!ConvertCsvToPointFile(argv[1], axis_csv, out_path))
+        return 1;
+
+    MappedPointFile file(out_path);
+    if(!file.Good())
+        return 1;
+    std::cout << "Wrote " << file.Profile().size() << " profile and " << file.Axis().size() << " axis points to "
+              << out_path << std::endl;
+}
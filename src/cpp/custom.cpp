@@ -5,61 +5,34 @@
 #include "custom_shape.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <event_bus.h>
+#include "vase_editor.h"
+#include "event_log.h"
+#include "gl_state.h"
 #include <glm/gtx/norm.hpp>
 
-struct LeftClickEvent : public Event
+/// Per frame shader inputs, laid out as the std140 Frame block in the shaders.
+struct FrameUniforms
 {
-    glm::vec2 wpos; 
+    glm::mat4 mvp;
+    glm::vec4 lightPos1; // w is padding.
+    glm::vec4 lightPos2;
+    glm::vec4 uvTransform; // uv = inUV.xy * uvTransform.xy + uvTransform.zw.
 };
 
-struct RightClickEvent : public Event
-{
-    glm::vec2 wpos; 
-};
-
-struct RButtonEvent : public Event {};
-struct PButtonEvent : public Event {};
-struct KButtonEvent : public Event {};
-
-std::pair<float, glm::vec2> minimum_distance(glm::vec2 v, glm::vec2 w, glm::vec2 p) 
-{
-  // Consider the line extending the segment, parameterized as v + t (w - v).
-  // We find projection of point p onto the line. 
-  // It falls where t = [(p-v) . (w-v)] / |w-v|^2
-  // We clamp t from [0,1] to handle points outside the segment vw.
-  const float l2 = glm::distance2(v, w);  // i.e. |w-v|^2 -  avoid a sqrt
-  const float t = std::max(0.0f, std::min(1.0f, glm::dot(p - v, w - v) / l2));
-  const glm::vec2 projection = v + t * (w - v);  // Projection falls on the segment
-  return std::make_pair(glm::distance(p, projection), projection);
-}
-
-std::pair<float, glm::vec2> minimum_distance(std::vector<glm::vec3> curve_2d, glm::vec2 p)
-{
-    float min_dist = FLT_MAX;
-    std::pair<float, glm::vec2> res;
-    for(int i = 0; i < curve_2d.size() - 1; ++i)
-    {
-        glm::vec2 v(curve_2d[i]); 
-        glm::vec2 w(curve_2d[i+1]); 
-        auto pr = minimum_distance(v, w, p);
-        if(pr.first < min_dist)
-		{
-            res = pr;
-			min_dist = pr.first;
-		}
-    }
-    return res;
-}
-
-
 class CustomExample : public OglwrapExample {
     private:
-        Curve curve;
-        Curve axis;
-        Mesh mesh;
+        VaseEditor editor;
         Curve center_line;
-        bool rotate = false;
-        bool mode = true; // true = draw, false = set axis.
+        EventRecorder* recorder; // Session recording, if enabled. Owned by the event bus.
+        bool drawing = false; // A mouse button was down last frame.
+        Curve hover_ring; // Highlights the profile row under the cursor in 3D view.
+        ProfileHit hover;
+        bool view_dirty = true; // The camera, light or hover highlight changed since the last frame.
+        bool drawn_rotate = false; // View of the last frame.
+        bool animate_light = false;
+        double light_time = 0; // Animation time of the moving light.
+        double last_update = 0;
+        double last_sample = 0; // Last time the mouse buttons were sampled.
         float camAng = 0;
         glm::vec3 camPos = {1, 1, 0};
         glm::vec3 lookPos = {0, 0, 0};
@@ -70,139 +43,30 @@ class CustomExample : public OglwrapExample {
 
         // A shader program
         gl::Program prog_;
-        
-        struct PlacePointHandler : public EventHandler
-        {
-            Curve& curve;
-            Curve& axis;
-            bool& mode;
 
-            PlacePointHandler (Curve& curve_, Curve& axis_, bool& mode_) : curve{curve_}, axis{axis_}, mode{mode_} {}
-            virtual void Handle (std::shared_ptr<Event> e) override
-            {
-                auto ecast = std::static_pointer_cast<LeftClickEvent>(e);
-                auto wpos = ecast->wpos;
-                if(mode)
-                    curve.AddPoint(glm::vec3(ecast->wpos, 0));
-                else
-                    axis.AddPoint(glm::vec3(ecast->wpos, 0));
-            }
-        };
-        std::shared_ptr<PlacePointHandler> m_place_point_handler;
+        // Per frame uniforms, shared by the shaders through a uniform buffer.
+        UniformBlock<FrameUniforms> frame_block{0};
 
-        friend class ViewHandler;
-        struct ViewHandler : public EventHandler
+        // Toggles the light animation. It is off by default, so nothing needs redrawing while the user only looks.
+        struct LightHandler : public EventHandler
         {
-            CustomExample& example;
-            ViewHandler(CustomExample& example_) : example{example_} {}
+            bool& animate_light;
+            LightHandler(bool& animate_light_) : animate_light{animate_light_} {}
             virtual void Handle (std::shared_ptr<Event>) override
             {
-                example.rotate = !example.rotate;
+                animate_light = !animate_light;
             }
         };
-        std::shared_ptr<ViewHandler> m_view_handler;
-
-        friend class ModeHandler;
-        struct ModeHandler : public EventHandler
-        {
-            CustomExample& example;
-            ModeHandler(CustomExample& example_) : example{example_} {}
-            virtual void Handle (std::shared_ptr<Event>) override
-            {
-                example.mode = !example.mode;
-            }
-        };
-        std::shared_ptr<ModeHandler> m_mode_handler;
-
-        struct RotateHandler : public EventHandler
-        {
-            Curve& curve;
-            Curve& axis;
-            Mesh& mesh;
-
-            RotateHandler (Curve& curve_, Curve& axis_, Mesh& mesh_) : curve{curve_}, axis{axis_}, mesh{mesh_} {}
-            virtual void Handle (std::shared_ptr<Event> e) override 
-            {
-                if(!mesh.GetPositions().empty())
-                    mesh.Set({}, {});
-
-                // Rotate curve positions around Y axis.
-                auto const& curve_pos = curve.GetPositions(); 
-                auto const& axis_pos = axis.GetPositions(); 
-                int n_incs = 100;
-                double inc = 2 * M_PI / n_incs;
-                std::vector<glm::vec3> mesh_pos(3 * n_incs * curve_pos.size());
-                std::vector<unsigned> mesh_inds(6 * n_incs * curve_pos.size());
-                auto pos_it = mesh_pos.begin();
-                auto norm_it = mesh_pos.begin() + mesh_pos.size() / 3;
-                auto uv_it = mesh_pos.begin() + 2 * mesh_pos.size() / 3;
-                auto ind_it = mesh_inds.begin();
-                for(int j = 0; j < curve_pos.size(); ++j)
-                {
-                    auto const& p = curve_pos[j];
-                    auto const& p_next = curve_pos[(j + 1) % curve_pos.size()];
-                    auto const& p_prev = curve_pos[(j - 1) % curve_pos.size()];
-
-                    // Get normal vector to p - p_next and p_prev - p by rotating by 90 degrees (x, y) -> (-y, x).
-                    auto nm_next = glm::vec2(p_next.y - p.y, p.x - p_next.x);
-                    auto nm_prev = glm::vec2(p.y - p_prev.y, p_prev.x - p.x);
-
-                    // Average normals to get this point's normal.
-                    auto nm = 0.5f * (nm_next + nm_prev);
-
-                    // Get vector v = p - proj where proj is the projection of p onto axis.
-                    auto pr = minimum_distance(axis_pos, glm::vec2(p.x, p.y));
-                    float dist = pr.first;
-                    glm::vec3 proj = glm::vec3(pr.second, 0);
-                    glm::vec3 v = p - proj;
-
-                    // Get angle between y axis and v.
-                    float ang = -std::atan2(v.x, v.y) + M_PI_2;
-                    
-                    for(int i = 0; i < n_incs; ++i)
-                    {
-                        double t{inc * i};
-                        double r = 3 + (1/4.0) * std::tanh(4 * sin(12 * t));
-//                        double r = 1;
-
-                        // First rotate around y, then rotate by ang, then add proj back.
-                        glm::vec3 rot = glm::vec3(r * cos(t), 0, r * sin(t)) * dist;
-                        rot = {rot.x * cos(ang) - rot.y * sin(ang), 
-                               rot.x * sin(ang) + rot.y * cos(ang),
-                               rot.z};
-                        *pos_it++ = rot + proj;
-
-                        // Set normal by applying rotation to 2d normal.
-                        *norm_it++ = glm::normalize(glm::vec3{nm.x * r * cos(t), nm.y, nm.x * r * sin(t)});
-
-                        *uv_it++ = glm::vec3(5 + 10 * i / float(n_incs), 5 + 10 * j / float(curve_pos.size() - 1), 0);
-
-                        #define T2to1(i, j) ((j) % curve_pos.size()) * n_incs + (i) % n_incs
-                        *ind_it++ = T2to1(i, j);
-                        *ind_it++ = T2to1(i+1, j);
-                        *ind_it++ = T2to1(i, j+1);
-
-                        *ind_it++ = T2to1(i+1, j+1);
-                        *ind_it++ = T2to1(i, j+1);
-                        *ind_it++ = T2to1(i+1, j);
-                        #undef T2to1
-                    }
-                }
-                mesh.Set(std::move(mesh_pos), std::move(mesh_inds));
-            }
-        };
-        std::shared_ptr<RotateHandler> m_rotate_handler;
+        std::shared_ptr<LightHandler> m_light_handler;
 
     public:
-        CustomExample ()
-            : curve(), axis(),
-              rotate{false},
-              center_line(),
-              m_place_point_handler{new PlacePointHandler(curve, axis, mode)},
-              m_view_handler{new ViewHandler(*this)},
-              m_mode_handler{new ModeHandler(*this)},
-              m_rotate_handler{new RotateHandler(curve, axis, mesh)}
+        CustomExample (EventRecorder* recorder_ = nullptr, Residency residency = kKeepCpuCopy)
+            : center_line(),
+              recorder{recorder_},
+              m_light_handler{new LightHandler(animate_light)}
             {
+                editor.SetResidency(residency);
+                EventBus::Subscribe(EventBus::GetID<LButtonEvent>(), m_light_handler);
 //                for(int i = 0; i < 100; ++i)
 //                {
 //                    float t = M_PI * 2 * i / 100.0;
@@ -213,11 +77,6 @@ class CustomExample : public OglwrapExample {
 //                axis.AddPoint({0,0.1,0});
 //                axis.AddPoint({-0.1,0,0});
 //                axis.AddPoint({0.1,0,0});
-                EventBus::Subscribe(EventBus::GetID<LeftClickEvent>(), m_place_point_handler);
-                EventBus::Subscribe(EventBus::GetID<RightClickEvent>(), m_place_point_handler);
-                EventBus::Subscribe(EventBus::GetID<RButtonEvent>(), m_rotate_handler);
-                EventBus::Subscribe(EventBus::GetID<PButtonEvent>(), m_view_handler);
-                EventBus::Subscribe(EventBus::GetID<KButtonEvent>(), m_mode_handler);
 
 //                center_line.SetPositions({{0,0,0}, {0, 5, 0}});
 
@@ -232,13 +91,18 @@ class CustomExample : public OglwrapExample {
       out vec3 position;
       out vec2 uv;
 
-      uniform mat4 mvp;
+      layout(std140) uniform Frame {
+        mat4 mvp;
+        vec3 lightPos1;
+        vec3 lightPos2;
+        vec4 uvTransform;
+      };
 
       void main() {
         gl_Position = mvp * vec4(inPos, 1.0);
         position = vec3(gl_Position);
         normal = inNorm;
-        uv = vec2(inUV);
+        uv = inUV.xy * uvTransform.xy + uvTransform.zw;
       })""");
                 vs_source.set_source_file("example_shader.vert");
                 gl::Shader vs(gl::kVertexShader, vs_source);
@@ -251,8 +115,12 @@ class CustomExample : public OglwrapExample {
       in vec3 normal;
       in vec3 position;
       in vec2 uv;
-      uniform vec3 lightPos1;
-      uniform vec3 lightPos2;
+      layout(std140) uniform Frame {
+        mat4 mvp;
+        vec3 lightPos1;
+        vec3 lightPos2;
+        vec4 uvTransform;
+      };
       uniform sampler2D tex;
 
       void main() {
@@ -273,7 +141,8 @@ class CustomExample : public OglwrapExample {
                 prog_.attachShader(vs);
                 prog_.attachShader(fs);
                 prog_.link();
-                gl::Use(prog_);
+                GlState::UseProgram(prog_.expose());
+                frame_block.Attach(prog_.expose(), "Frame");
 
                 // Bind the attribute locations
                 (prog_ | "inPos").bindLocation(CustomShape::kPosition);
@@ -307,32 +176,122 @@ class CustomExample : public OglwrapExample {
                 }
             }
 
+        // Load a profile and axis from a point file, e.g. converted from a scan with csv2points.
+        bool Load(std::string const& path)
+        {
+            auto start = std::chrono::steady_clock::now();
+            if(!editor.Load(path))
+                return false;
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Loaded " << editor.curve.Size() << " profile and " << editor.axis.Size() << " axis points in "
+                      << ms << " ms" << std::endl;
+            return true;
+        }
+
     protected:
+        virtual bool Update() override
+        {
+            bool busy = HandleMouse();
+            busy = HandleKeys() || busy;
+            if(editor.rotate)
+                HandleHover(ViewProj());
+
+            // Advance the light by the time since the last update, so pausing it keeps its position.
+            double now = glfwGetTime();
+            if(animate_light)
+            {
+                light_time += now - last_update;
+                view_dirty = true;
+            }
+            last_update = now;
+            return busy || animate_light;
+        }
+
+        virtual bool NeedsRedraw() override
+        {
+            return view_dirty || editor.rotate != drawn_rotate || editor.curve.Dirty() || editor.axis.Dirty() ||
+                   editor.mesh.Dirty() || center_line.Dirty();
+        }
+
         virtual void Render() override 
+        {
+            if(recorder)
+                recorder->BeginFrame();
+            FrameUniforms frame;
+            if(!editor.rotate)
+                frame.mvp = glm::mat4(1.0f);
+            else
+                frame.mvp = ViewProj();
+
+            glm::vec3 lightPos1 = {1, 1, 0};
+            glm::vec3 lightPos2 = {0, sin(light_time / 3 * 2 * M_PI) - 1, 0};
+            frame.lightPos1 = glm::vec4(lightPos1, 0);
+            frame.lightPos2 = glm::vec4(lightPos2, 0);
+
+            // The solid stores the angular step and row of each vertex as uv, spread them over 10 texture repeats.
+            size_t n_rows = editor.mesh.VertexCount() / kRevolveIncrements;
+            frame.uvTransform = glm::vec4(10.0f / kRevolveIncrements, n_rows > 1 ? 10.0f / (n_rows - 1) : 0.0f, 5, 5);
+            GlState::UseProgram(prog_.expose());
+            frame_block.Set(frame);
+            GlState::Uniform("tex", 0);
+            editor.curve.Render();
+            editor.axis.Render();
+            editor.mesh.Render();
+            center_line.Render();
+            if(editor.rotate && hover.hit)
+                hover_ring.Render();
+            view_dirty = false;
+            drawn_rotate = editor.rotate;
+        }
+
+        // Transform of the 3D view.
+        glm::mat4 ViewProj() const
         {
             float t = glfwGetTime();
             glm::mat4 camera_mat = glm::lookAt(camPos, lookPos, glm::vec3{0.0f, 1.0f, 0.0f});
             glm::mat4 model_mat = glm::rotate(glm::mat4(1.0f), 0 * glm::radians(t) * 100, glm::vec3(0,1,0));
             glm::mat4 proj_mat = glm::perspectiveFov<float>(M_PI/3.0, kScreenWidth, kScreenHeight, 0.1, 100);
-            if(!rotate)
-                gl::Uniform<glm::mat4>(prog_, "mvp") = glm::mat4(1.0f);
-            else
-                gl::Uniform<glm::mat4>(prog_, "mvp") = proj_mat * camera_mat * model_mat;
+            return proj_mat * camera_mat * model_mat;
+        }
 
-            glm::vec3 lightPos1 = {1, 1, 0};
-            glm::vec3 lightPos2 = {0, sin(t / 3 * 2 * M_PI) - 1, 0};
-            gl::Uniform<glm::vec3>(prog_, "lightPos1") = lightPos1;
-            gl::Uniform<glm::vec3>(prog_, "lightPos2") = lightPos2;
-            HandleMouse();
-            HandleKeys();
-            curve.Render();
-            axis.Render();
-            mesh.Render();
-            center_line.Render();
+        // Pick the revolved surface under the cursor and highlight the hit row.
+        void HandleHover(glm::mat4 const& view_proj)
+        {
+            if(editor.picker.Empty())
+            {
+                view_dirty = view_dirty || hover.hit;
+                hover = ProfileHit();
+                return;
+            }
+
+            double xpos, ypos;
+            glfwGetCursorPos(window_, &xpos, &ypos);
+            glm::vec2 ndc = glm::vec2(2) * glm::vec2(xpos, ypos) / glm::vec2(kScreenWidth, -kScreenHeight) + glm::vec2(-1, 1);
+
+            ProfileHit hit = editor.picker.Pick(ScreenRay(ndc, view_proj));
+            if(hit.hit && (!hover.hit || hit.row != hover.row))
+            {
+                std::vector<glm::vec3> ring(kRevolveIncrements + 1);
+                for(int i = 0; i <= kRevolveIncrements; ++i)
+                    ring[i] = editor.picker.SurfacePoint(hit.row, i % kRevolveIncrements);
+                hover_ring.SetPositions(std::move(ring));
+            }
+            view_dirty = view_dirty || hit.hit != hover.hit || (hit.hit && hit.row != hover.row);
+            hover = hit;
         }
 
-        void HandleMouse()
+        // Returns true while a mouse button is down.
+        bool HandleMouse()
         {
+            // Input wakes the loop more often than the frame rate, e.g. on every mouse move. Sample the buttons at
+            // most once per frame interval, so strokes get as many points as with a redraw every frame.
+            double now = glfwGetTime();
+            bool down = glfwGetMouseButton(window_, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS ||
+                        glfwGetMouseButton(window_, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+            if(down && now - last_sample < kFrameInterval)
+                return true;
+            last_sample = now;
+
             // Get cursor position. 
             double xpos, ypos;
             glfwGetCursorPos(window_, &xpos, &ypos);
@@ -359,10 +318,21 @@ class CustomExample : public OglwrapExample {
                 e->wpos = wpos;
                 EventBus::Publish(e, EventBus::GetID<RightClickEvent>());
             }
+
+            // Releasing the buttons ends the stroke.
+            if(drawing && !down)
+            {
+                std::shared_ptr<StrokeEndEvent> e{new StrokeEndEvent};
+                EventBus::Publish(e, EventBus::GetID<StrokeEndEvent>());
+            }
+            drawing = down;
+            return down;
         }
 
-        void HandleKeys()
+        // Returns true while a key that moves the camera is held.
+        bool HandleKeys()
         {
+            glm::vec3 old_cam_pos = camPos, old_look_pos = lookPos;
             if(glfwGetKey(window_, GLFW_KEY_W) == GLFW_PRESS)
                 camPos.y += 0.05;
 
@@ -386,6 +356,10 @@ class CustomExample : public OglwrapExample {
 
             if(glfwGetKey(window_, GLFW_KEY_DOWN) == GLFW_PRESS)
                 lookPos.y -= 0.01;
+
+            bool moved = camPos != old_cam_pos || lookPos != old_look_pos;
+            view_dirty = view_dirty || moved;
+            return moved;
         }
 
         // Handles keys on events (i.e., hold/unhold, not just is/isn't pressed).
@@ -409,19 +383,105 @@ class CustomExample : public OglwrapExample {
                 EventBus::Publish(e, EventBus::GetID<RButtonEvent>());
             }
 
-            if(key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+            if(key == GLFW_KEY_L && action == GLFW_PRESS)
+            {
+                std::shared_ptr<LButtonEvent> e{new LButtonEvent};
+                EventBus::Publish(e, EventBus::GetID<LButtonEvent>());
+            }
+
+            if(key == GLFW_KEY_I && action == GLFW_PRESS)
             {
-                std::cout << " Bye bye :)" << std::endl;
-                glfwTerminate();
-                exit(0);
+                std::shared_ptr<IntersectionCheckEvent> e{new IntersectionCheckEvent};
+                EventBus::Publish(e, EventBus::GetID<IntersectionCheckEvent>());
             }
+
+            if(key == GLFW_KEY_G && action == GLFW_PRESS)
+            {
+                if(mods & GLFW_MOD_SHIFT)
+                {
+                    std::shared_ptr<SpiralSliceEvent> e{new SpiralSliceEvent};
+                    EventBus::Publish(e, EventBus::GetID<SpiralSliceEvent>());
+                }
+                else
+                {
+                    std::shared_ptr<SliceEvent> e{new SliceEvent};
+                    EventBus::Publish(e, EventBus::GetID<SliceEvent>());
+                }
+            }
+
+            if(key == GLFW_KEY_Z && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL))
+            {
+                if(mods & GLFW_MOD_SHIFT)
+                {
+                    std::shared_ptr<RedoEvent> e{new RedoEvent};
+                    EventBus::Publish(e, EventBus::GetID<RedoEvent>());
+                }
+                else
+                {
+                    std::shared_ptr<UndoEvent> e{new UndoEvent};
+                    EventBus::Publish(e, EventBus::GetID<UndoEvent>());
+                }
+            }
+
+            if(key == GLFW_KEY_Y && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL))
+            {
+                std::shared_ptr<RedoEvent> e{new RedoEvent};
+                EventBus::Publish(e, EventBus::GetID<RedoEvent>());
+            }
+
+            if(key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+                glfwSetWindowShouldClose(window, true);
         }
         
 };
 
-int main() {
+int main(int argc, char** argv) {
     EventBus::CreateSingleton();
+    GlState::CreateSingleton(std::unique_ptr<GlBackend>(new OpenGlBackend));
     TestWrapper wrapper;
-    CustomExample().RunMainLoop();
+
+    // Options:
+    //   --record <file>  Write the session's input events to a log that replay can run again.
+    //   --gpu-resident   Keep the curves and the solid only on the GPU.
+    //   --load <file>    Start with the profile and axis of a point file.
+    std::string record_path, load_path;
+    Residency residency = kKeepCpuCopy;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if(arg == "--record" && i + 1 < argc)
+            record_path = argv[++i];
+        else if(arg == "--gpu-resident")
+            residency = kGpuOnly;
+        else if(arg == "--load" && i + 1 < argc)
+            load_path = argv[++i];
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--record <file>] [--gpu-resident] [--load <point file>]" << std::endl;
+            return 1;
+        }
+    }
+
+    EventRecorder* recorder = nullptr;
+    if(!record_path.empty())
+    {
+        EventCodec codec;
+        RegisterEvents(&codec);
+        std::shared_ptr<EventRecorder> tap{new EventRecorder(codec, record_path)};
+        if(tap->Good())
+        {
+            // The bus owns the recorder, so the log is closed on exit.
+            EventBus::SetTap(tap);
+            recorder = tap.get();
+        }
+    }
+
+    CustomExample example(recorder, residency);
+    if(!load_path.empty() && !example.Load(load_path))
+        return 1;
+    example.RunMainLoop();
+    GlState::PrintStats(std::cout);
+    example.PrintFrameStats(std::cout);
+    std::cout << " Bye bye :)" << std::endl;
 }
 
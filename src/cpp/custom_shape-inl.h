@@ -107,56 +107,304 @@ inline void CustomShape::createTexCoords(std::vector<glm::vec3>* data) {
 }
 
 Curve::Curve ()
+    : m_vao{GlState::Backend().GenVertexArray()}, m_buffer{GlState::Backend().GenBuffer()}
 {
     // Create positions vertex attribute pointer.
-    UpdatePositions();
+    GlState::BindVertexArray(m_vao);
+    GlState::BindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    GlState::Backend().VertexAttribPointer(0, 3, 0, nullptr);
 }
 
-void Curve::UpdatePositions () 
+Curve::~Curve ()
+{
+    GlState::DeleteBuffer(m_buffer);
+    GlState::DeleteVertexArray(m_vao);
+}
+
+void Curve::UpdatePositions (size_t first) 
 {
     // Set indices data.
-    Bind(m_vao);
-    Bind(m_buffer);
-    gl::VertexAttrib(0).pointer(3, gl::DataType::kFloat, false, 0, nullptr).enable();
-    m_buffer.data(m_positions);
-    Unbind(m_buffer);
-    Unbind(m_vao);
+    auto& backend = GlState::Backend();
+    GlState::BindVertexArray(m_vao);
+    GlState::BindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    if(Size() > m_capacity)
+    {
+        // Grow geometrically so appends only upload the new points.
+        // The new buffer starts empty, so points that are only on the GPU are read back first.
+        Fetch();
+        m_capacity = std::max<size_t>(64, 2 * Size());
+        backend.BufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
+        UploadView(0, m_base);
+        first = m_cpu_first;
+    }
+    m_dirty = true;
+    if(first < Size())
+        backend.BufferSubData(GL_ARRAY_BUFFER, first * sizeof(glm::vec3), (Size() - first) * sizeof(glm::vec3), &m_positions[first - m_cpu_first]);
+    Release();
+}
+
+void Curve::UploadView (size_t first, PointView points)
+{
+    std::vector<glm::vec3> chunk;
+    for(size_t done = 0; done < points.size(); done += kUploadChunk)
+    {
+        chunk.resize(std::min(size_t(kUploadChunk), points.size() - done));
+        for(size_t i = 0; i < chunk.size(); ++i)
+            chunk[i] = points[done + i];
+        GlState::Backend().BufferSubData(GL_ARRAY_BUFFER, (first + done) * sizeof(glm::vec3), chunk.size() * sizeof(glm::vec3), chunk.data());
+    }
+}
+
+void Curve::Fetch ()
+{
+    if(m_cpu_first == 0 || !m_base.empty())
+        return;
+    m_positions = GetPositions();
+    m_cpu_first = 0;
+}
+
+void Curve::Release ()
+{
+    if(m_residency != kGpuOnly)
+        return;
+    m_cpu_first = Size();
+    std::vector<glm::vec3>().swap(m_positions);
+    m_base = PointView();
+    m_base_owner.reset();
+}
+
+std::vector<glm::vec3> Curve::GetPositions () const
+{
+    std::vector<glm::vec3> positions(Size());
+    for(size_t i = 0; i < m_base.size(); ++i)
+        positions[i] = m_base[i];
+    if(m_cpu_first > 0 && m_base.empty())
+    {
+        GlState::BindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        GlState::Backend().GetBufferSubData(GL_ARRAY_BUFFER, 0, m_cpu_first * sizeof(glm::vec3), positions.data());
+    }
+    std::copy(m_positions.begin(), m_positions.end(), positions.begin() + m_cpu_first);
+    return positions;
+}
+
+void Curve::SetPositions (PointView points, std::shared_ptr<void const> owner)
+{
+    if(m_residency == kKeepCpuCopy && !owner)
+    {
+        SetPositions(points.ToVector());
+        return;
+    }
+
+    GlState::BindVertexArray(m_vao);
+    GlState::BindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    std::vector<glm::vec3>().swap(m_positions);
+    if(points.size() > m_capacity)
+    {
+        // Sized exactly, appending to a loaded profile grows the buffer geometrically from there.
+        m_capacity = std::max<size_t>(64, points.size());
+        GlState::Backend().BufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
+    }
+    UploadView(0, points);
+    m_cpu_first = points.size();
+    m_base = points;
+    m_base_owner = std::move(owner);
+    m_dirty = true;
+    Release();
+}
+
+PointView Curve::Points (std::vector<glm::vec3>* storage) const
+{
+    if(m_cpu_first == 0)
+        return PointView(m_positions);
+    if(m_positions.empty() && !m_base.empty())
+        return m_base;
+    *storage = GetPositions();
+    return PointView(*storage);
+}
+
+void Curve::SetResidency (Residency residency)
+{
+    m_residency = residency;
+    if(residency == kKeepCpuCopy)
+        Fetch();
+    else
+        Release();
 }
 
 void Curve::Render () 
 {
-    Bind(m_vao);
-    gl::DrawArrays(gl::PrimType::kLineStrip, 0, m_positions.size());
-    Unbind(m_vao);
+    // Bindings are left in place, GlState skips them when the next draw uses the same ones.
+    GlState::BindVertexArray(m_vao);
+    GlState::Backend().DrawArrays(GL_LINE_STRIP, 0, Size());
+    m_dirty = false;
 }
 
 Mesh::Mesh () 
+    : m_vao{GlState::Backend().GenVertexArray()}, m_buffer{GlState::Backend().GenBuffer()}, m_ind_buffer{GlState::Backend().GenBuffer()}
 {
     // Create positions vertex attribute pointer.
+    GlState::BindVertexArray(m_vao);
+    GlState::BindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    GlState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ind_buffer);
     UpdateVao();
 }
 
+Mesh::~Mesh ()
+{
+    GlState::DeleteBuffer(m_ind_buffer);
+    GlState::DeleteBuffer(m_buffer);
+    GlState::DeleteVertexArray(m_vao);
+}
+
 void Mesh::UpdateVao () 
 {
-    // Set indices data.
-    Bind(m_vao);
-    Bind(m_buffer);
-    Bind(m_ind_buffer);
-    gl::VertexAttrib(0).pointer(3, gl::DataType::kFloat, false, 0, nullptr).enable();
-    gl::VertexAttrib(1).pointer(3, gl::DataType::kFloat, false, 0, (void*)(m_positions.size() / 3 * sizeof(glm::vec3))).enable();
-    gl::VertexAttrib(2).pointer(3, gl::DataType::kFloat, false, 0, (void*)(2 * m_positions.size() / 3 * sizeof(glm::vec3))).enable();
-    m_buffer.data(m_positions);
-    m_ind_buffer.data(m_indices);
-    Unbind(m_ind_buffer);
-    Unbind(m_buffer);
-    Unbind(m_vao);
+    auto& backend = GlState::Backend();
+    backend.VertexAttribPointer(0, 3, 0, nullptr);
+    backend.VertexAttribPointer(1, 3, 0, (void*)(m_vertex_capacity * sizeof(glm::vec3)));
+    backend.VertexAttribPointer(2, 3, 0, (void*)(2 * m_vertex_capacity * sizeof(glm::vec3)));
+}
+
+std::vector<glm::vec3> Mesh::FetchRegion (int region, size_t n) const
+{
+    std::vector<glm::vec3> data(n);
+    GlState::BindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    GlState::Backend().GetBufferSubData(GL_ARRAY_BUFFER, region * m_vertex_capacity * sizeof(glm::vec3), n * sizeof(glm::vec3), data.data());
+    return data;
+}
+
+std::vector<unsigned> Mesh::FetchIndices (size_t n) const
+{
+    // The index buffer is only bound through the VAO.
+    std::vector<unsigned> indices(n);
+    GlState::BindVertexArray(m_vao);
+    GlState::Backend().GetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, n * sizeof(unsigned), indices.data());
+    return indices;
+}
+
+void Mesh::UploadVertices (size_t first, glm::vec3 const* positions, glm::vec3 const* normals, glm::vec3 const* uvs, size_t n)
+{
+    if(n == 0)
+        return;
+    auto& backend = GlState::Backend();
+    GlState::BindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glm::vec3 const* regions[3] = {positions, normals, uvs};
+    for(int k = 0; k < 3; ++k)
+        backend.BufferSubData(GL_ARRAY_BUFFER, (k * m_vertex_capacity + first) * sizeof(glm::vec3), n * sizeof(glm::vec3), regions[k]);
+}
+
+void Mesh::UploadIndices (size_t first, unsigned const* indices, size_t n)
+{
+    if(n == 0)
+        return;
+    GlState::BindVertexArray(m_vao);
+    GlState::Backend().BufferSubData(GL_ELEMENT_ARRAY_BUFFER, first * sizeof(unsigned), n * sizeof(unsigned), indices);
+}
+
+void Mesh::Resize (size_t n_vertices, size_t n_indices)
+{
+    auto& backend = GlState::Backend();
+    GlState::BindVertexArray(m_vao);
+    if(n_vertices > m_vertex_capacity)
+    {
+        // The new buffer starts empty, so the vertices that are kept are uploaded again, from RAM or read back.
+        size_t keep = std::min(m_n_vertices, n_vertices);
+        std::vector<glm::vec3> regions[3];
+        for(int k = 0; k < 3; ++k)
+            regions[k] = m_residency == kGpuOnly ? FetchRegion(k, keep) : std::vector<glm::vec3>();
+        // A mesh generated from nothing is sized exactly, appending to it grows the buffer geometrically from there.
+        m_vertex_capacity = std::max<size_t>(64, keep == 0 ? n_vertices : 2 * n_vertices);
+        GlState::BindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        backend.BufferData(GL_ARRAY_BUFFER, 3 * m_vertex_capacity * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
+        UpdateVao();
+        if(m_residency == kGpuOnly)
+            UploadVertices(0, regions[0].data(), regions[1].data(), regions[2].data(), keep);
+        else
+            UploadVertices(0, m_positions.data(), m_normals.data(), m_uvs.data(), keep);
+    }
+    if(n_indices > m_index_capacity)
+    {
+        size_t keep = std::min(m_n_indices, n_indices);
+        std::vector<unsigned> kept = m_residency == kGpuOnly ? FetchIndices(keep) : std::vector<unsigned>();
+        m_index_capacity = std::max<size_t>(64, keep == 0 ? n_indices : 2 * n_indices);
+        GlState::BindVertexArray(m_vao);
+        backend.BufferData(GL_ELEMENT_ARRAY_BUFFER, m_index_capacity * sizeof(unsigned), nullptr, GL_DYNAMIC_DRAW);
+        UploadIndices(0, m_residency == kGpuOnly ? kept.data() : m_indices.data(), keep);
+    }
+    m_n_vertices = n_vertices;
+    m_n_indices = n_indices;
+    if(m_residency != kGpuOnly)
+    {
+        m_positions.resize(n_vertices);
+        m_normals.resize(n_vertices);
+        m_uvs.resize(n_vertices);
+        m_indices.resize(n_indices);
+    }
+    m_dirty = true;
+}
+
+void Mesh::SetVertices (size_t first, glm::vec3 const* positions, glm::vec3 const* normals, glm::vec3 const* uvs, size_t n)
+{
+    if(m_residency != kGpuOnly)
+    {
+        std::copy(positions, positions + n, m_positions.begin() + first);
+        std::copy(normals, normals + n, m_normals.begin() + first);
+        std::copy(uvs, uvs + n, m_uvs.begin() + first);
+    }
+    UploadVertices(first, positions, normals, uvs, n);
+    m_dirty = true;
+}
+
+void Mesh::SetIndices (size_t first, unsigned const* indices, size_t n)
+{
+    if(m_residency != kGpuOnly)
+        std::copy(indices, indices + n, m_indices.begin() + first);
+    UploadIndices(first, indices, n);
+    m_dirty = true;
+}
+
+void Mesh::Release ()
+{
+    if(m_residency != kGpuOnly)
+        return;
+    std::vector<glm::vec3>().swap(m_positions);
+    std::vector<glm::vec3>().swap(m_normals);
+    std::vector<glm::vec3>().swap(m_uvs);
+    std::vector<unsigned>().swap(m_indices);
+}
+
+std::vector<glm::vec3> const& Mesh::Positions (std::vector<glm::vec3>* storage) const
+{
+    if(m_residency != kGpuOnly)
+        return m_positions;
+    *storage = FetchRegion(0, m_n_vertices);
+    return *storage;
+}
+
+std::vector<unsigned> const& Mesh::Indices (std::vector<unsigned>* storage) const
+{
+    if(m_residency != kGpuOnly)
+        return m_indices;
+    *storage = FetchIndices(m_n_indices);
+    return *storage;
+}
+
+void Mesh::SetResidency (Residency residency)
+{
+    if(residency == kKeepCpuCopy && m_residency == kGpuOnly)
+    {
+        m_positions = FetchRegion(0, m_n_vertices);
+        m_normals = FetchRegion(1, m_n_vertices);
+        m_uvs = FetchRegion(2, m_n_vertices);
+        m_indices = FetchIndices(m_n_indices);
+    }
+    m_residency = residency;
+    Release();
 }
 
 void Mesh::Render () 
 {
-    Bind(m_vao);
-    Bind(m_ind_buffer);
-    gl::DrawElements(gl::PrimType::kTriangles, m_indices.size(), gl::IndexType::kUnsignedInt);
-    Unbind(m_ind_buffer);
-    Unbind(m_vao);
+    // The index buffer binding is part of the VAO.
+    GlState::BindVertexArray(m_vao);
+    GlState::Backend().DrawElements(GL_TRIANGLES, m_n_indices, GL_UNSIGNED_INT);
+    m_dirty = false;
 }
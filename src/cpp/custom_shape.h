@@ -1,11 +1,14 @@
 #pragma once
 
+#include <memory>
 #include <set>
 #include <vector>
 #include <oglwrap/buffer.h>
 #include <oglwrap/context.h>
 #include <oglwrap/vertex_array.h>
 #include <oglwrap/vertex_attrib.h>
+#include "gl_state.h"
+#include "point_view.h"
 
 class CustomShape {
 public:
@@ -32,65 +35,212 @@ private:
     static void createTexCoords(std::vector<glm::vec3>* data);
 };
 
+/// Where the data of a Curve or Mesh is kept once it is uploaded.
+enum Residency
+{
+    kKeepCpuCopy, ///< In RAM and on the GPU.
+    kGpuOnly      ///< Only on the GPU. The RAM copy is dropped after upload and read back when it is needed.
+};
+
+/// Bytes an object holds in RAM and on the GPU.
+struct MemoryUsage
+{
+    size_t cpu_bytes;
+    size_t gpu_bytes;
+
+    MemoryUsage& operator+= (MemoryUsage const& o) {cpu_bytes += o.cpu_bytes; gpu_bytes += o.gpu_bytes; return *this;}
+};
+
 /// 2 or 3 D curve
+/// GL objects are created through the GlState backend, so curves (and meshes) also work headless with MockGlBackend.
 class Curve 
 {
 private:
+    /// Points [m_cpu_first, Size()) of the curve. With kKeepCpuCopy m_cpu_first is 0 unless the first points are
+    /// viewed in place, with kGpuOnly the vector only holds points that were added but not yet uploaded.
     std::vector<glm::vec3> m_positions;
-    gl::VertexArray m_vao;
-    gl::ArrayBuffer m_buffer;
+    size_t m_cpu_first = 0;
+    /// Points [0, m_cpu_first) when they are viewed in place, e.g. in a mapped point file kept alive by the owner.
+    /// Empty when those points are only on the GPU.
+    PointView m_base;
+    std::shared_ptr<void const> m_base_owner;
+    size_t m_capacity = 0; ///< Number of points the GPU buffer has room for.
+    Residency m_residency = kKeepCpuCopy;
+    bool m_dirty = true;
+    GLuint m_vao;
+    GLuint m_buffer;
+
+    /// Upload positions [first, end) to the GPU, growing the buffer if needed.
+    void UpdatePositions (size_t first = 0);
+
+    /// Upload a view to positions [first, first + points.size()) in chunks.
+    void UploadView (size_t first, PointView points);
+
+    /// Read the points that are only on the GPU back into m_positions.
+    void Fetch ();
+
+    /// Drop the RAM copy of the points if the curve is kGpuOnly.
+    void Release ();
 
-    void UpdatePositions ();
+    /// Points converted per upload when a curve is uploaded from a view.
+    static const size_t kUploadChunk = 1 << 16;
 
 public:
     Curve (); 
+    ~Curve ();
+    Curve (Curve const&) = delete;
+    Curve& operator= (Curve const&) = delete;
 
     /// Render the curve.
     void Render();
 
     /// Extend the curve by adding a new point.
+    /// Only the new point is uploaded, so drawing a stroke point by point costs linear time overall.
     void AddPoint(glm::vec3 const& point) 
     {
         m_positions.push_back(point);
-        UpdatePositions();
+        UpdatePositions(Size() - 1);
+    }
+
+    /// Extend the curve by adding several points.
+    void AddPoints(std::vector<glm::vec3> const& points)
+    {
+        size_t first = Size();
+        m_positions.insert(m_positions.end(), points.begin(), points.end());
+        UpdatePositions(first);
+    }
+
+    /// Drop points from the end of the curve, keeping the first n.
+    void Truncate(size_t n)
+    {
+        if(n >= Size())
+            return;
+        m_dirty = true;
+        if(n >= m_cpu_first)
+            m_positions.resize(n - m_cpu_first);
+        else
+        {
+            m_positions.clear();
+            m_cpu_first = n;
+            if(!m_base.empty())
+                m_base = m_base.First(n);
+        }
     }
 
     /// Set positions of vertices in curve.
     void SetPositions(std::vector<glm::vec3>&& positions)
     {
         m_positions = std::move(positions);
+        m_cpu_first = 0;
+        m_base = PointView();
+        m_base_owner.reset();
         UpdatePositions();
     }
 
-    std::vector<glm::vec3> GetPositions () const {return m_positions;} 
+    /// Set positions from a view, e.g. of a mapped point file, uploading them in chunks. A kKeepCpuCopy curve keeps
+    /// referring to the points if an owner that keeps them alive is given, and copies them otherwise. A kGpuOnly curve
+    /// never holds all of them in RAM.
+    void SetPositions(PointView points, std::shared_ptr<void const> owner = nullptr);
+
+    size_t Size () const {return m_cpu_first + m_positions.size();}
+
+    /// Whether the curve changed since it was last rendered.
+    bool Dirty () const {return m_dirty;}
+
+    /// Copy of the points. With kGpuOnly they are read back from the GPU.
+    std::vector<glm::vec3> GetPositions () const;
+
+    /// View of all points. Points that are only on the GPU, or that were added to viewed points, are copied into
+    /// storage first, otherwise the view refers to the RAM copy or the viewed points and stays valid until the curve
+    /// changes.
+    PointView Points (std::vector<glm::vec3>* storage) const;
+
+    /// Choose whether to keep the points in RAM after they are uploaded.
+    void SetResidency (Residency residency);
+    Residency GetResidency () const {return m_residency;}
+
+    MemoryUsage Memory () const {return {m_positions.capacity() * sizeof(glm::vec3), m_capacity * sizeof(glm::vec3)};}
 };
 
+/// Indexed triangle mesh with positions, normals and uvs.
+/// The GPU buffer holds the three attributes in regions of room for a number of vertices each, so vertices and
+/// indices can be overwritten in place and appended to, uploading only what changed.
 class Mesh 
 {
 private:
-    std::vector<glm::vec3> m_positions;
+    std::vector<glm::vec3> m_positions, m_normals, m_uvs;
     std::vector<unsigned> m_indices;
-    gl::VertexArray m_vao;
-    gl::ArrayBuffer m_buffer;
-    gl::IndexBuffer m_ind_buffer;
-
+    size_t m_n_vertices = 0, m_n_indices = 0; ///< Sizes of the data on the GPU.
+    size_t m_vertex_capacity = 0, m_index_capacity = 0; ///< Room in the GPU buffers.
+    Residency m_residency = kKeepCpuCopy;
+    bool m_dirty = true;
+    GLuint m_vao;
+    GLuint m_buffer;
+    GLuint m_ind_buffer;
+
+    /// Point the attributes at the regions of the vertex buffer.
     void UpdateVao ();
 
+    /// Read vertices [0, n) of one attribute region (positions, normals, uvs) back from the GPU.
+    std::vector<glm::vec3> FetchRegion (int region, size_t n) const;
+
+    /// Read indices [0, n) back from the GPU.
+    std::vector<unsigned> FetchIndices (size_t n) const;
+
+    /// Upload vertices [first, first + n) or indices [first, first + n) without touching the RAM copy.
+    void UploadVertices (size_t first, glm::vec3 const* positions, glm::vec3 const* normals, glm::vec3 const* uvs, size_t n);
+    void UploadIndices (size_t first, unsigned const* indices, size_t n);
+
+    /// Drop the RAM copy of the data if the mesh is kGpuOnly.
+    void Release ();
+
 public:
     Mesh ();
+    ~Mesh ();
+    Mesh (Mesh const&) = delete;
+    Mesh& operator= (Mesh const&) = delete;
 
     /// Render the mesh.
     void Render();
 
-    /// Set positions.
-    void Set (std::vector<glm::vec3>&& positions, std::vector<unsigned>&& indices)
+    /// Change the number of vertices and indices. The first ones keep their data, new ones are undefined until set.
+    /// The buffers grow geometrically, so appending a few rows at a time costs linear time overall.
+    void Resize (size_t n_vertices, size_t n_indices);
+
+    /// Overwrite vertices [first, first + n).
+    void SetVertices (size_t first, glm::vec3 const* positions, glm::vec3 const* normals, glm::vec3 const* uvs, size_t n);
+
+    /// Overwrite indices [first, first + n).
+    void SetIndices (size_t first, unsigned const* indices, size_t n);
+
+    /// Remove all triangles.
+    void Clear () {Resize(0, 0);}
+
+    bool Empty () const {return m_n_indices == 0;}
+
+    size_t VertexCount () const {return m_n_vertices;}
+
+    /// Whether the mesh changed since it was last rendered.
+    bool Dirty () const {return m_dirty;}
+
+    /// Vertex positions in RAM. With kGpuOnly they are read back into storage first, otherwise the RAM copy is
+    /// returned and stays valid until the mesh changes.
+    std::vector<glm::vec3> const& Positions (std::vector<glm::vec3>* storage) const;
+
+    /// Triangle indices in RAM, see Positions.
+    std::vector<unsigned> const& Indices (std::vector<unsigned>* storage) const;
+
+    /// Choose whether to keep the data in RAM after it is uploaded.
+    void SetResidency (Residency residency);
+
+    Residency GetResidency () const {return m_residency;}
+
+    MemoryUsage Memory () const
     {
-        m_positions = std::move(positions);
-        m_indices = std::move(indices);
-        UpdateVao ();
+        return {(m_positions.capacity() + m_normals.capacity() + m_uvs.capacity()) * sizeof(glm::vec3) +
+                    m_indices.capacity() * sizeof(unsigned),
+                3 * m_vertex_capacity * sizeof(glm::vec3) + m_index_capacity * sizeof(unsigned)};
     }
-
-    std::vector<glm::vec3> GetPositions () const {return m_positions;} 
 };
 
 #include "custom_shape-inl.h"
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include "persistent_points.h"
+
+/// Undo/redo history of the drawn profile and axis.
+///
+/// Every entry holds a full version of both curves, but the versions share structure, so an entry only costs
+/// memory for the points that changed since the previous one. Moving through the history is O(1); callers sync
+/// their curves with CommonPrefix, which is O(log n) per changed point.
+class EditHistory
+{
+public:
+    /// Curves tracked by the history.
+    enum Target {kCurve, kAxis};
+
+    struct State
+    {
+        PersistentPoints curve;
+        PersistentPoints axis;
+
+        PersistentPoints const& Get (Target target) const {return target == kCurve ? curve : axis;}
+        PersistentPoints& Get (Target target) {return target == kCurve ? curve : axis;}
+    };
+
+private:
+    std::vector<State> m_states{State()};
+    size_t m_current = 0;
+    State m_working;
+
+public:
+    /// The state as currently edited, including changes not yet committed.
+    State const& Working () const {return m_working;}
+
+    /// Record a point appended to one of the curves.
+    void AddPoint (Target target, glm::vec3 const& point) {m_working.Get(target).PushBack(point);}
+
+    /// Replace one of the curves, e.g. with a profile loaded from a file.
+    void Set (Target target, PersistentPoints points) {m_working.Get(target) = std::move(points);}
+
+    /// Make the working state a history entry, e.g. at the end of a stroke. Discards the redo entries.
+    /// \return false if nothing changed since the last entry.
+    bool Commit ()
+    {
+        State const& last = m_states[m_current];
+        if(Same(last.curve, m_working.curve) && Same(last.axis, m_working.axis))
+            return false;
+        m_states.resize(m_current + 1);
+        m_states.push_back(m_working);
+        ++m_current;
+        return true;
+    }
+
+    /// Bytes of RAM taken by the entries, counting the nodes they share once. Nodes in seen are not counted, those
+    /// of the entries are added to it.
+    size_t Bytes (std::unordered_set<void const*>* seen) const
+    {
+        size_t bytes = m_states.capacity() * sizeof(State) + m_working.curve.Bytes(seen) + m_working.axis.Bytes(seen);
+        for(auto const& state: m_states)
+            bytes += state.curve.Bytes(seen) + state.axis.Bytes(seen);
+        return bytes;
+    }
+
+    bool CanUndo () const {return m_current > 0;}
+    bool CanRedo () const {return m_current + 1 < m_states.size();}
+
+    /// Step back one entry. Uncommitted changes are dropped.
+    State const& Undo ()
+    {
+        if(CanUndo())
+            --m_current;
+        m_working = m_states[m_current];
+        return m_working;
+    }
+
+    /// Step forward one entry. Uncommitted changes are dropped.
+    State const& Redo ()
+    {
+        if(CanRedo())
+            ++m_current;
+        m_working = m_states[m_current];
+        return m_working;
+    }
+
+private:
+    static bool Same (PersistentPoints const& a, PersistentPoints const& b)
+    {
+        return a.Size() == b.Size() && a.CommonPrefix(b) == a.Size();
+    }
+};
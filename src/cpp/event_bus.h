@@ -16,6 +16,15 @@ struct EventHandler
     virtual ~EventHandler () {}
 };
 
+/// Observer of the events published on a bus, e.g. to record a session.
+struct EventTap
+{
+    /// Called for events published from outside a handler, before they are handled.
+    /// Events that handlers publish in turn are not passed on, as handling the outer event publishes them again.
+    virtual void Published (std::shared_ptr<Event> const& e, size_t eid) = 0;
+    virtual ~EventTap () {}
+};
+
 /// An event bus relays information from publishers to subscribers when events happen according to the the pub-sub pattern.
 /// It is a singleton class.
 class EventBus 
@@ -23,6 +32,8 @@ class EventBus
 private:
     static std::unique_ptr<EventBus> ms_singleton;
     std::unordered_map<size_t, std::vector<std::shared_ptr<EventHandler>>> subscriptions;
+    std::shared_ptr<EventTap> tap;
+    int depth = 0; ///< Number of Publish calls in progress.
 
     /// Note that the constructor is private because this a singleton.
     EventBus () = default;
@@ -43,8 +54,18 @@ public:
     /// \param [in] eid Event ID. This can be retrieved from Event by running EventBus::GetID<Event>().
     static void Publish (std::shared_ptr<Event> e, size_t eid)
     {
+        if(ms_singleton->tap && ms_singleton->depth == 0)
+            ms_singleton->tap->Published(e, eid);
+        ++ms_singleton->depth;
         for(auto& handler: ms_singleton->subscriptions[eid])
             handler->Handle(e);
+        --ms_singleton->depth;
+    }
+
+    /// Set the tap that observes published events. Pass nullptr to remove it.
+    static void SetTap (std::shared_ptr<EventTap> tap) 
+    {
+        ms_singleton->tap = tap;
     }
 
     /// Get ID associated with an event.
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "event_bus.h"
+
+/// Gives event types stable one byte tags and converts their payloads to bytes, so that a session can be written to a
+/// log and published again later. Events of types that are not registered are not logged.
+class EventCodec
+{
+public:
+    static const size_t kMaxPayload = 16;
+
+    struct Entry
+    {
+        uint8_t tag;
+        size_t eid;
+        std::string name;
+        size_t payload_size;
+        std::function<void(Event const&, char*)> write;
+        std::function<std::shared_ptr<Event>(char const*)> read;
+    };
+
+private:
+    std::vector<Entry> m_entries;
+    std::array<int, 256> m_by_tag;
+
+    void Add (Entry&& entry)
+    {
+        m_by_tag[entry.tag] = m_entries.size();
+        m_entries.push_back(std::move(entry));
+    }
+
+public:
+    EventCodec () {m_by_tag.fill(-1);}
+
+    /// Register an event type without payload.
+    template <typename EventT>
+    void Register (uint8_t tag, std::string const& name)
+    {
+        Add({tag, EventBus::GetID<EventT>(), name, 0,
+             [](Event const&, char*) {},
+             [](char const*) {return std::shared_ptr<Event>(new EventT);}});
+    }
+
+    /// Register an event type whose payload is a 2D position.
+    /// \param [in] field The position member, e.g. &LeftClickEvent::wpos.
+    template <typename EventT>
+    void Register (uint8_t tag, std::string const& name, glm::vec2 EventT::* field)
+    {
+        Add({tag, EventBus::GetID<EventT>(), name, 2 * sizeof(float),
+             [field](Event const& e, char* out)
+             {
+                 glm::vec2 const& v = static_cast<EventT const&>(e).*field;
+                 float xy[2] = {v.x, v.y};
+                 std::memcpy(out, xy, sizeof(xy));
+             },
+             [field](char const* in)
+             {
+                 float xy[2];
+                 std::memcpy(xy, in, sizeof(xy));
+                 std::shared_ptr<EventT> e{new EventT};
+                 (*e).*field = glm::vec2(xy[0], xy[1]);
+                 return std::shared_ptr<Event>(e);
+             }});
+    }
+
+    Entry const* FindID (size_t eid) const
+    {
+        for(auto const& entry: m_entries)
+            if(entry.eid == eid)
+                return &entry;
+        return nullptr;
+    }
+
+    Entry const* FindTag (uint8_t tag) const {return m_by_tag[tag] < 0 ? nullptr : &m_entries[m_by_tag[tag]];}
+
+    std::vector<Entry> const& Entries () const {return m_entries;}
+};
+
+/// Event log format: the magic "VSEV" and a uint32 version, then one record per event:
+/// uint32 frame, float seconds since recording started, uint8 tag, then the payload of the tag's event type.
+/// Values are stored in host byte order.
+const char kEventLogMagic[4] = {'V', 'S', 'E', 'V'};
+const uint32_t kEventLogVersion = 1;
+
+/// Writes the events published on the bus to a log. Set it as the tap of the bus.
+class EventRecorder : public EventTap
+{
+private:
+    EventCodec m_codec;
+    std::ofstream m_out;
+    uint32_t m_frame = 0;
+    size_t m_count = 0;
+    std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+
+    template <typename T>
+    void Write (T const& value) {m_out.write(reinterpret_cast<char const*>(&value), sizeof(T));}
+
+public:
+    EventRecorder (EventCodec const& codec, std::string const& path)
+        : m_codec{codec}, m_out{path, std::ios::binary}
+    {
+        if(!m_out)
+        {
+            std::cerr << "Could not open event log " << path << " for writing" << std::endl;
+            return;
+        }
+        m_out.write(kEventLogMagic, sizeof(kEventLogMagic));
+        Write(kEventLogVersion);
+    }
+
+    bool Good () const {return bool(m_out);}
+
+    /// Mark the start of a new frame. Events are logged with the number of the frame they happened in.
+    void BeginFrame () {++m_frame;}
+
+    size_t Count () const {return m_count;}
+
+    virtual void Published (std::shared_ptr<Event> const& e, size_t eid) override
+    {
+        EventCodec::Entry const* entry = m_codec.FindID(eid);
+        if(!entry || !m_out)
+            return;
+
+        char payload[EventCodec::kMaxPayload];
+        entry->write(*e, payload);
+        float time = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_start).count();
+        Write(m_frame);
+        Write(time);
+        Write(entry->tag);
+        m_out.write(payload, entry->payload_size);
+        ++m_count;
+    }
+};
+
+/// An event read back from a log.
+struct LoggedEvent
+{
+    uint32_t frame;
+    float time;
+    EventCodec::Entry const* entry;
+    std::shared_ptr<Event> event;
+};
+
+/// Read all events from a log written by EventRecorder.
+/// \return false if the file could not be read, is not an event log or holds tags the codec does not know.
+inline bool ReadEventLog (std::string const& path, EventCodec const& codec, std::vector<LoggedEvent>* events)
+{
+    std::ifstream in{path, std::ios::binary};
+    char magic[sizeof(kEventLogMagic)];
+    uint32_t version;
+    if(!in.read(magic, sizeof(magic)) || std::memcmp(magic, kEventLogMagic, sizeof(magic)) != 0 ||
+       !in.read(reinterpret_cast<char*>(&version), sizeof(version)) || version != kEventLogVersion)
+    {
+        std::cerr << path << " is not a version " << kEventLogVersion << " event log" << std::endl;
+        return false;
+    }
+
+    LoggedEvent ev;
+    uint8_t tag;
+    char payload[EventCodec::kMaxPayload];
+    while(in.read(reinterpret_cast<char*>(&ev.frame), sizeof(ev.frame)))
+    {
+        if(!in.read(reinterpret_cast<char*>(&ev.time), sizeof(ev.time)) || !in.read(reinterpret_cast<char*>(&tag), 1))
+        {
+            std::cerr << path << " ends in the middle of an event" << std::endl;
+            return false;
+        }
+        ev.entry = codec.FindTag(tag);
+        if(!ev.entry)
+        {
+            std::cerr << path << " has unknown event tag " << int(tag) << std::endl;
+            return false;
+        }
+        if(!in.read(payload, ev.entry->payload_size))
+        {
+            std::cerr << path << " ends in the middle of an event" << std::endl;
+            return false;
+        }
+        ev.event = ev.entry->read(payload);
+        events->push_back(ev);
+    }
+    return true;
+}
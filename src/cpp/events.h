@@ -0,0 +1,54 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "event_bus.h"
+#include "event_log.h"
+
+struct LeftClickEvent : public Event
+{
+    glm::vec2 wpos;
+};
+
+struct RightClickEvent : public Event
+{
+    glm::vec2 wpos;
+};
+
+struct RButtonEvent : public Event {};
+struct PButtonEvent : public Event {};
+struct KButtonEvent : public Event {};
+struct UndoEvent : public Event {};
+struct RedoEvent : public Event {};
+struct LButtonEvent : public Event {};
+
+/// Slice the solid into print layers (g), or into a vase mode spiral (shift+g).
+struct SliceEvent : public Event {};
+struct SpiralSliceEvent : public Event {};
+
+/// Check the solid for self intersections (i).
+struct IntersectionCheckEvent : public Event {};
+
+/// Published when the mouse button that was drawing is released.
+struct StrokeEndEvent : public Event {};
+
+/// Published when the profile or axis changed other than by drawing, e.g. by undo.
+struct ProfileChangedEvent : public Event {};
+
+/// Register the events that come from user input with their log tags.
+/// Tags are stored in event logs, so existing ones must not change. ProfileChangedEvent is only published by
+/// handlers and is not logged.
+inline void RegisterEvents (EventCodec* codec)
+{
+    codec->Register<LeftClickEvent>(1, "left click", &LeftClickEvent::wpos);
+    codec->Register<RightClickEvent>(2, "right click", &RightClickEvent::wpos);
+    codec->Register<RButtonEvent>(3, "r (revolve)");
+    codec->Register<PButtonEvent>(4, "p (view)");
+    codec->Register<KButtonEvent>(5, "k (mode)");
+    codec->Register<UndoEvent>(6, "undo");
+    codec->Register<RedoEvent>(7, "redo");
+    codec->Register<StrokeEndEvent>(8, "stroke end");
+    codec->Register<SliceEvent>(9, "g (slice)");
+    codec->Register<SpiralSliceEvent>(10, "shift+g (spiral)");
+    codec->Register<LButtonEvent>(11, "l (light)");
+    codec->Register<IntersectionCheckEvent>(12, "i (check)");
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <glad/glad.h>
+
+/// The GL calls the renderer makes, behind an interface so that GlState can sit in front of them and a mock can
+/// stand in for the driver.
+class GlBackend
+{
+public:
+    virtual ~GlBackend () {}
+
+    virtual GLuint GenBuffer () = 0;
+    virtual void DeleteBuffer (GLuint buffer) = 0;
+    virtual GLuint GenVertexArray () = 0;
+    virtual void DeleteVertexArray (GLuint vao) = 0;
+    virtual void BindVertexArray (GLuint vao) = 0;
+    virtual void BindBuffer (GLenum target, GLuint buffer) = 0;
+    virtual void BindBufferBase (GLenum target, GLuint index, GLuint buffer) = 0;
+    virtual void BufferData (GLenum target, GLsizeiptr size, const void* data, GLenum usage) = 0;
+    virtual void BufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, const void* data) = 0;
+    virtual void GetBufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, void* data) = 0;
+    virtual void VertexAttribPointer (GLuint index, GLint size, GLsizei stride, const void* offset) = 0;
+    virtual void UseProgram (GLuint program) = 0;
+    virtual GLint GetUniformLocation (GLuint program, const char* name) = 0;
+    virtual void Uniform1i (GLint location, GLint value) = 0;
+    virtual void UniformBlockBinding (GLuint program, const char* block, GLuint binding) = 0;
+    virtual void DrawArrays (GLenum mode, GLint first, GLsizei count) = 0;
+    virtual void DrawElements (GLenum mode, GLsizei count, GLenum type) = 0;
+};
+
+/// Backend that calls the driver.
+class OpenGlBackend : public GlBackend
+{
+public:
+    virtual GLuint GenBuffer () override {GLuint b; glGenBuffers(1, &b); return b;}
+    virtual void DeleteBuffer (GLuint buffer) override {glDeleteBuffers(1, &buffer);}
+    virtual GLuint GenVertexArray () override {GLuint v; glGenVertexArrays(1, &v); return v;}
+    virtual void DeleteVertexArray (GLuint vao) override {glDeleteVertexArrays(1, &vao);}
+    virtual void BindVertexArray (GLuint vao) override {glBindVertexArray(vao);}
+    virtual void BindBuffer (GLenum target, GLuint buffer) override {glBindBuffer(target, buffer);}
+    virtual void BindBufferBase (GLenum target, GLuint index, GLuint buffer) override {glBindBufferBase(target, index, buffer);}
+    virtual void BufferData (GLenum target, GLsizeiptr size, const void* data, GLenum usage) override {glBufferData(target, size, data, usage);}
+    virtual void BufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, const void* data) override {glBufferSubData(target, offset, size, data);}
+    virtual void GetBufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, void* data) override {glGetBufferSubData(target, offset, size, data);}
+    virtual void VertexAttribPointer (GLuint index, GLint size, GLsizei stride, const void* offset) override
+    {
+        glVertexAttribPointer(index, size, GL_FLOAT, GL_FALSE, stride, offset);
+        glEnableVertexAttribArray(index);
+    }
+    virtual void UseProgram (GLuint program) override {glUseProgram(program);}
+    virtual GLint GetUniformLocation (GLuint program, const char* name) override {return glGetUniformLocation(program, name);}
+    virtual void Uniform1i (GLint location, GLint value) override {glUniform1i(location, value);}
+    virtual void UniformBlockBinding (GLuint program, const char* block, GLuint binding) override
+    {
+        GLuint index = glGetUniformBlockIndex(program, block);
+        if(index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, binding);
+    }
+    virtual void DrawArrays (GLenum mode, GLint first, GLsizei count) override {glDrawArrays(mode, first, count);}
+    virtual void DrawElements (GLenum mode, GLsizei count, GLenum type) override {glDrawElements(mode, count, type, nullptr);}
+};
+
+/// Backend without a GPU. It counts calls and keeps buffer contents in RAM, so data can be read back as from GL.
+class MockGlBackend : public GlBackend
+{
+public:
+    /// Calls received, by GlBackend method name.
+    std::unordered_map<std::string, size_t> calls;
+    std::unordered_map<std::string, GLint> locations;
+    std::unordered_map<GLuint, std::vector<char>> buffers;
+    GLuint next_name = 1;
+
+private:
+    GLuint m_vao = 0;
+    std::unordered_map<GLenum, GLuint> m_bound;
+    std::unordered_map<GLuint, GLuint> m_vao_elements;
+
+    /// Contents of the buffer bound to target. Element arrays are bound per VAO, as in GL.
+    std::vector<char>& Bound (GLenum target) {return buffers[target == GL_ELEMENT_ARRAY_BUFFER ? m_vao_elements[m_vao] : m_bound[target]];}
+
+public:
+    virtual GLuint GenBuffer () override {++calls["GenBuffer"]; return next_name++;}
+    virtual void DeleteBuffer (GLuint buffer) override {++calls["DeleteBuffer"]; buffers.erase(buffer);}
+    virtual GLuint GenVertexArray () override {++calls["GenVertexArray"]; return next_name++;}
+    virtual void DeleteVertexArray (GLuint vao) override {++calls["DeleteVertexArray"]; m_vao_elements.erase(vao);}
+    virtual void BindVertexArray (GLuint vao) override {++calls["BindVertexArray"]; m_vao = vao;}
+    virtual void BindBuffer (GLenum target, GLuint buffer) override
+    {
+        ++calls["BindBuffer"];
+        (target == GL_ELEMENT_ARRAY_BUFFER ? m_vao_elements[m_vao] : m_bound[target]) = buffer;
+    }
+    virtual void BindBufferBase (GLenum target, GLuint, GLuint buffer) override {++calls["BindBufferBase"]; m_bound[target] = buffer;}
+    virtual void BufferData (GLenum target, GLsizeiptr size, const void* data, GLenum) override
+    {
+        ++calls["BufferData"];
+        auto& contents = Bound(target);
+        contents.assign(size, 0);
+        if(data)
+            std::memcpy(contents.data(), data, size);
+    }
+    virtual void BufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, const void* data) override
+    {
+        ++calls["BufferSubData"];
+        std::memcpy(Bound(target).data() + offset, data, size);
+    }
+    virtual void GetBufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, void* data) override
+    {
+        ++calls["GetBufferSubData"];
+        std::memcpy(data, Bound(target).data() + offset, size);
+    }
+    virtual void VertexAttribPointer (GLuint, GLint, GLsizei, const void*) override {++calls["VertexAttribPointer"];}
+    virtual void UseProgram (GLuint) override {++calls["UseProgram"];}
+    virtual GLint GetUniformLocation (GLuint, const char* name) override
+    {
+        ++calls["GetUniformLocation"];
+        auto it = locations.find(name);
+        return it != locations.end() ? it->second : (locations[name] = GLint(locations.size()));
+    }
+    virtual void Uniform1i (GLint, GLint) override {++calls["Uniform1i"];}
+    virtual void UniformBlockBinding (GLuint, const char*, GLuint) override {++calls["UniformBlockBinding"];}
+    virtual void DrawArrays (GLenum, GLint, GLsizei) override {++calls["DrawArrays"];}
+    virtual void DrawElements (GLenum, GLsizei, GLenum) override {++calls["DrawElements"];}
+
+    size_t Total () const
+    {
+        size_t n = 0;
+        for(auto const& c: calls)
+            n += c.second;
+        return n;
+    }
+};
+
+/// Tracks the GL state set through it and drops calls that would not change it.
+/// Binds, program switches, uniform location lookups and uniform uploads are cached. All GL state these cover must
+/// be changed through GlState, or Invalidate must be called afterwards.
+/// It is a singleton class.
+class GlState
+{
+public:
+    enum CallType {kBindVertexArray, kBindBuffer, kUseProgram, kUniformLocation, kUniform, kBufferUpload, kCallTypeNum};
+
+    /// Number of calls passed on to the backend and elided, by type.
+    struct Stats
+    {
+        size_t issued[kCallTypeNum] = {};
+        size_t elided[kCallTypeNum] = {};
+    };
+
+private:
+    static std::unique_ptr<GlState> ms_singleton;
+    std::unique_ptr<GlBackend> m_backend;
+
+    GLuint m_vao = 0;
+    GLuint m_program = 0;
+    std::unordered_map<GLenum, GLuint> m_buffers;        ///< Bound buffer by target, except element arrays.
+    std::unordered_map<GLuint, GLuint> m_vao_elements;   ///< Element array bound in each VAO.
+    std::unordered_map<GLuint, std::unordered_map<std::string, GLint>> m_locations;
+    std::unordered_map<uint64_t, GLint> m_int_uniforms;  ///< Last value by (program, location).
+    Stats m_stats;
+    bool m_caching = true;
+
+    GlState (std::unique_ptr<GlBackend> backend) : m_backend{std::move(backend)} {}
+
+    static bool Count (CallType type, bool needed)
+    {
+        needed = needed || !ms_singleton->m_caching;
+        (needed ? ms_singleton->m_stats.issued : ms_singleton->m_stats.elided)[type]++;
+        return needed;
+    }
+
+public:
+    /// Create the singleton instance. NOTE THIS IS NECESSARY BEFORE CREATING ANY Curve OR Mesh!
+    static void CreateSingleton (std::unique_ptr<GlBackend> backend) {ms_singleton.reset(new GlState(std::move(backend)));}
+
+    /// The backend, for calls GlState does not track (uploads, draws).
+    static GlBackend& Backend () {return *ms_singleton->m_backend;}
+
+    static void BindVertexArray (GLuint vao)
+    {
+        if(Count(kBindVertexArray, ms_singleton->m_vao != vao))
+        {
+            ms_singleton->m_backend->BindVertexArray(vao);
+            ms_singleton->m_vao = vao;
+        }
+    }
+
+    /// Bind a buffer. Element array bindings are remembered per VAO, as GL stores them there.
+    static void BindBuffer (GLenum target, GLuint buffer)
+    {
+        GLuint& bound = target == GL_ELEMENT_ARRAY_BUFFER ? ms_singleton->m_vao_elements[ms_singleton->m_vao] : ms_singleton->m_buffers[target];
+        if(Count(kBindBuffer, bound != buffer))
+        {
+            ms_singleton->m_backend->BindBuffer(target, buffer);
+            bound = buffer;
+        }
+    }
+
+    static void UseProgram (GLuint program)
+    {
+        if(Count(kUseProgram, ms_singleton->m_program != program))
+        {
+            ms_singleton->m_backend->UseProgram(program);
+            ms_singleton->m_program = program;
+        }
+    }
+
+    /// Location of a uniform, looked up by name only the first time.
+    static GLint UniformLocation (GLuint program, std::string const& name)
+    {
+        auto& locations = ms_singleton->m_locations[program];
+        auto it = locations.find(name);
+        if(!Count(kUniformLocation, it == locations.end()))
+            return it->second;
+        GLint location = ms_singleton->m_backend->GetUniformLocation(program, name.c_str());
+        locations[name] = location;
+        return location;
+    }
+
+    /// Set an integer (or sampler) uniform of the current program, skipping the upload if it already has the value.
+    static void Uniform (std::string const& name, GLint value)
+    {
+        GLint location = UniformLocation(ms_singleton->m_program, name);
+        if(location < 0)
+            return;
+        uint64_t key = (uint64_t(ms_singleton->m_program) << 32) | uint32_t(location);
+        auto it = ms_singleton->m_int_uniforms.find(key);
+        if(Count(kUniform, it == ms_singleton->m_int_uniforms.end() || it->second != value))
+        {
+            ms_singleton->m_backend->Uniform1i(location, value);
+            ms_singleton->m_int_uniforms[key] = value;
+        }
+    }
+
+    /// Delete a VAO, forgetting it if it is bound. GL may hand out the name again.
+    static void DeleteVertexArray (GLuint vao)
+    {
+        if(ms_singleton->m_vao == vao)
+            ms_singleton->m_vao = 0;
+        ms_singleton->m_vao_elements.erase(vao);
+        ms_singleton->m_backend->DeleteVertexArray(vao);
+    }
+
+    /// Delete a buffer, forgetting it wherever it is bound.
+    static void DeleteBuffer (GLuint buffer)
+    {
+        for(auto& bound: ms_singleton->m_buffers)
+            if(bound.second == buffer)
+                bound.second = 0;
+        for(auto& bound: ms_singleton->m_vao_elements)
+            if(bound.second == buffer)
+                bound.second = 0;
+        ms_singleton->m_backend->DeleteBuffer(buffer);
+    }
+
+    /// Count a buffer upload, which uniform blocks use to report skipped uploads.
+    static bool CountUpload (bool needed) {return Count(kBufferUpload, needed);}
+
+    /// Forget the tracked state, e.g. after GL calls made outside of GlState.
+    static void Invalidate ()
+    {
+        ms_singleton->m_vao = 0;
+        ms_singleton->m_program = 0;
+        ms_singleton->m_buffers.clear();
+        ms_singleton->m_vao_elements.clear();
+        ms_singleton->m_int_uniforms.clear();
+    }
+
+    /// Turn eliding calls off or on, e.g. to measure what the cache saves. State is still tracked while it is off.
+    static void SetCaching (bool enabled) {ms_singleton->m_caching = enabled;}
+
+    static Stats const& GetStats () {return ms_singleton->m_stats;}
+    static void ResetStats () {ms_singleton->m_stats = Stats();}
+
+    static void PrintStats (std::ostream& os)
+    {
+        const char* names[kCallTypeNum] = {"vao binds", "buffer binds", "program switches", "uniform lookups", "uniform uploads", "buffer uploads"};
+        for(int i = 0; i < kCallTypeNum; ++i)
+            os << names[i] << ": " << ms_singleton->m_stats.issued[i] << " issued, " << ms_singleton->m_stats.elided[i] << " elided" << std::endl;
+    }
+};
+std::unique_ptr<GlState> GlState::ms_singleton;
+
+/// A uniform buffer holding one std140 block, e.g. per frame data shared by all shaders.
+/// Set only uploads when the contents changed.
+template <typename BlockT>
+class UniformBlock
+{
+private:
+    GLuint m_buffer;
+    GLuint m_binding;
+    BlockT m_value;
+    bool m_uploaded = false;
+
+public:
+    /// \param [in] binding Uniform buffer binding point the block is bound to.
+    explicit UniformBlock (GLuint binding) : m_buffer{GlState::Backend().GenBuffer()}, m_binding{binding}
+    {
+        GlState::BindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+        GlState::Backend().BufferData(GL_UNIFORM_BUFFER, sizeof(BlockT), nullptr, GL_DYNAMIC_DRAW);
+        GlState::Backend().BindBufferBase(GL_UNIFORM_BUFFER, m_binding, m_buffer);
+    }
+    ~UniformBlock () {GlState::DeleteBuffer(m_buffer);}
+    UniformBlock (UniformBlock const&) = delete;
+    UniformBlock& operator= (UniformBlock const&) = delete;
+
+    /// Connect the block called name in program to this buffer.
+    void Attach (GLuint program, const char* name) {GlState::Backend().UniformBlockBinding(program, name, m_binding);}
+
+    void Set (BlockT const& value)
+    {
+        if(!GlState::CountUpload(!m_uploaded || std::memcmp(&value, &m_value, sizeof(BlockT)) != 0))
+            return;
+        m_value = value;
+        m_uploaded = true;
+        GlState::BindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+        GlState::Backend().BufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(BlockT), &m_value);
+    }
+};
@@ -1,6 +1,7 @@
 // Copyright (c), Tamas Csala
 
 #include "oglwrap_example.hpp"
+#include <algorithm>
 
 OglwrapExample::OglwrapExample() {
     if (!glfwInit()) {
@@ -28,6 +29,10 @@ OglwrapExample::OglwrapExample() {
 
     glfwMakeContextCurrent(window_);
 
+    // The loop only draws when the scene changed, so damage to the window has to trigger a frame too.
+    glfwSetWindowUserPointer(window_, this);
+    glfwSetWindowRefreshCallback(window_, RefreshCallback);
+
     bool success = gladLoadGL();
     if (!success) {
         std::cerr << "gladLoadGL failed" << std::endl;
@@ -40,13 +45,60 @@ OglwrapExample::~OglwrapExample() {
 }
 
 void OglwrapExample::RunMainLoop() {
+    double next_update = glfwGetTime();
     while (!glfwWindowShouldClose(window_)) {
-        gl::Clear().Color().Depth();
+        double woke = glfwGetTime();
+        frame_stats_.wakeups++;
+        bool busy = Update();
+
+        if (NeedsRedraw() || refresh_needed_) {
+            refresh_needed_ = false;
+            double start = glfwGetTime();
+            gl::Clear().Color().Depth();
+
+            Render ();
+
+            glfwSwapBuffers(window_);
+            double end = glfwGetTime();
+            frame_stats_.frames++;
+            frame_stats_.frame_time += end - start;
+            frame_stats_.max_frame_time = std::max(frame_stats_.max_frame_time, end - start);
+            frame_stats_.latency += end - woke;
+            frame_stats_.max_latency = std::max(frame_stats_.max_latency, end - woke);
+        }
 
-        Render ();
+        // Sleep until the next event. While busy, also wake up for the next update, which paces held keys and
+        // animations to the frame rate. Input events still wake the loop right away.
+        double wait_start = glfwGetTime();
+        if (!busy) {
+            glfwWaitEvents();
+        } else {
+            next_update = std::max(next_update + kFrameInterval, wait_start);
+            if (next_update > wait_start) {
+                glfwWaitEventsTimeout(next_update - wait_start);
+            } else {
+                glfwPollEvents();
+            }
+        }
+        frame_stats_.wait_time += glfwGetTime() - wait_start;
+    }
+}
+
+void OglwrapExample::RefreshCallback(GLFWwindow* window) {
+    auto example = static_cast<OglwrapExample*>(glfwGetWindowUserPointer(window));
+    example->refresh_needed_ = true;
+    Wake();
+}
 
-        glfwSwapBuffers(window_);
-        glfwPollEvents();
+void OglwrapExample::PrintFrameStats(std::ostream& os) const {
+    FrameStats const& s = frame_stats_;
+    os << s.frames << " frames drawn in " << s.wakeups << " wakeups, "
+       << s.wait_time << " s idle" << std::endl;
+    if (s.frames > 0) {
+        os << "frame time: " << 1000 * s.frame_time / s.frames << " ms mean, "
+           << 1000 * s.max_frame_time << " ms max" << std::endl;
+        os << "wakeup to swap: " << 1000 * s.latency / s.frames << " ms mean, "
+           << 1000 * s.max_latency << " ms max" << std::endl;
     }
 }
 
@@ -14,16 +14,54 @@ public:
   OglwrapExample();
   ~OglwrapExample();
 
+  /// Runs until the window is closed. Frames are only drawn when NeedsRedraw says so, and while nothing is in
+  /// progress the loop sleeps until the next input event or Wake.
   void RunMainLoop();
 
+  /// Wakes the main loop, e.g. when a background job finished. Can be called from any thread.
+  static void Wake() { glfwPostEmptyEvent(); }
+
+  /// Frame pacing statistics of RunMainLoop.
+  struct FrameStats {
+    size_t wakeups = 0;       ///< Loop iterations, i.e. returns from waiting for events.
+    size_t frames = 0;        ///< Frames drawn.
+    double wait_time = 0;     ///< Seconds spent waiting for events.
+    double frame_time = 0;    ///< Seconds spent drawing and swapping.
+    double max_frame_time = 0;
+    double max_latency = 0;   ///< Longest time from waking up to the frame being swapped.
+    double latency = 0;       ///< Sum of the above over all frames.
+  };
+
+  FrameStats const& GetFrameStats() const { return frame_stats_; }
+  void PrintFrameStats(std::ostream& os) const;
+
 protected:
   GLFWwindow* window_;
   int kScreenWidth;
   int kScreenHeight;
 
+  /// Interval between updates while Update reports that something is in progress.
+  static constexpr double kFrameInterval = 1.0 / 60;
+
+  /// Handles input and advances the state, once per loop iteration.
+  /// Returns true while something is in progress that needs updates at the frame rate even without new input, e.g.
+  /// a held key or an animation. Otherwise the loop sleeps until the next event.
+  virtual bool Update() { return true; }
+
+  /// Returns true if the scene changed since it was last drawn.
+  virtual bool NeedsRedraw() { return true; }
+
   virtual void Render() = 0;
 
   std::string GetProjectDir();
+
+private:
+  FrameStats frame_stats_;
+
+  /// Set when the window system asks for the contents to be drawn again, e.g. after the window was uncovered.
+  bool refresh_needed_ = true;
+
+  static void RefreshCallback(GLFWwindow* window);
 };
 
 
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "point_view.h"
+
+/// Persistent sequence of points with structural sharing.
+///
+/// Points are stored in fixed size chunks at the leaves of a trie with a fixed branching factor. Copying a sequence
+/// is O(1) and shares every node; appending or changing a point copies only the O(log n) nodes on the path to its
+/// chunk, and only if another copy still shares them. A history of versions that each differ by a few points
+/// therefore costs memory proportional to the changes, not to the length of the sequence.
+///
+/// A sequence can also start with points it only views, e.g. the columns of a mapped point file, and keep them alive
+/// through a shared owner. Those are never copied unless one of them is replaced.
+class PersistentPoints
+{
+private:
+    static const int kBits = 5;
+    static const size_t kWidth = size_t(1) << kBits;
+    static const size_t kMask = kWidth - 1;
+
+    // Nodes are stored type erased, the height in the trie tells inner nodes and chunks apart.
+    struct Inner { std::array<std::shared_ptr<void>, kWidth> children; };
+    struct Chunk { std::array<glm::vec3, kWidth> points; };
+
+    PointView m_base; ///< Points [0, m_base.size()).
+    std::shared_ptr<void const> m_base_owner;
+
+    // Points [m_base.size(), Size()) are point m_base.size() + i at index i of the trie.
+    std::shared_ptr<void> m_root;
+    size_t m_size = 0; ///< Points in the trie.
+    int m_shift = 0; ///< kBits * (depth - 1). 0 means the root is a leaf.
+
+    /// Number of points a tree with the current depth can hold.
+    size_t Capacity () const {return m_root ? kWidth << m_shift : 0;}
+
+    /// Make a node writable by this sequence, copying it if it is shared.
+    template <typename NodeT>
+    static NodeT* Own (std::shared_ptr<void>& node)
+    {
+        if(!node)
+            node = std::make_shared<NodeT>();
+        else if(node.use_count() > 1)
+            node = std::make_shared<NodeT>(*static_cast<NodeT const*>(node.get()));
+        return static_cast<NodeT*>(node.get());
+    }
+
+    /// Length of the common prefix of the first limit points of subtrees a and b, both of height shift.
+    static size_t CommonPrefix (void const* a, void const* b, int shift, size_t limit)
+    {
+        if(a == b)
+            return limit;
+        if(!a || !b)
+            return 0;
+        if(shift == 0)
+        {
+            auto const& pa = static_cast<Chunk const*>(a)->points;
+            auto const& pb = static_cast<Chunk const*>(b)->points;
+            for(size_t i = 0; i < limit; ++i)
+                if(pa[i] != pb[i])
+                    return i;
+            return limit;
+        }
+        auto const& ca = static_cast<Inner const*>(a)->children;
+        auto const& cb = static_cast<Inner const*>(b)->children;
+        size_t span = size_t(1) << shift, done = 0;
+        for(size_t i = 0; i < kWidth && done < limit; ++i)
+        {
+            size_t n = std::min(span, limit - done);
+            size_t same = CommonPrefix(ca[i].get(), cb[i].get(), shift - kBits, n);
+            done += same;
+            if(same < n)
+                break;
+        }
+        return done;
+    }
+
+    /// Root of the subtree of height shift that holds the first points, descending from a deeper root.
+    void const* Descend (int shift) const
+    {
+        void const* node = m_root.get();
+        for(int s = m_shift; s > shift && node; s -= kBits)
+            node = static_cast<Inner const*>(node)->children[0].get();
+        return node;
+    }
+
+    /// Bytes of the nodes of a subtree of height shift that are not in seen yet, adding them to seen.
+    static size_t Bytes (void const* node, int shift, std::unordered_set<void const*>* seen)
+    {
+        if(!node || !seen->insert(node).second)
+            return 0;
+        if(shift == 0)
+            return sizeof(Chunk);
+        size_t bytes = sizeof(Inner);
+        for(auto const& child: static_cast<Inner const*>(node)->children)
+            bytes += Bytes(child.get(), shift - kBits, seen);
+        return bytes;
+    }
+
+    /// Chunk holding point i.
+    Chunk const* ChunkAt (size_t i) const
+    {
+        void const* node = m_root.get();
+        for(int s = m_shift; s > 0; s -= kBits)
+            node = static_cast<Inner const*>(node)->children[(i >> s) & kMask].get();
+        return static_cast<Chunk const*>(node);
+    }
+
+    /// Chunk holding point i, made writable by this sequence.
+    Chunk* OwnChunk (size_t i)
+    {
+        std::shared_ptr<void>* node = &m_root;
+        for(int s = m_shift; s > 0; s -= kBits)
+            node = &Own<Inner>(*node)->children[(i >> s) & kMask];
+        return Own<Chunk>(*node);
+    }
+
+    /// Length of the common prefix of points [0, limit) of the tries of a and b.
+    static size_t TrieCommonPrefix (PersistentPoints const& a, PersistentPoints const& b, size_t limit)
+    {
+        if(limit == 0)
+            return 0;
+        int shift = std::min(a.m_shift, b.m_shift);
+        return CommonPrefix(a.Descend(shift), b.Descend(shift), shift, limit);
+    }
+
+    /// Copy the viewed points into the trie, so any point can be replaced.
+    void DropBase ()
+    {
+        std::vector<glm::vec3> points;
+        CopyTo(0, &points);
+        *this = PersistentPoints(points);
+    }
+
+public:
+    PersistentPoints () {}
+
+    /// Build from a vector of points or a view of them.
+    explicit PersistentPoints (PointView points) {Append(points);}
+
+    /// Start with points viewed in place, which owner keeps alive.
+    PersistentPoints (PointView base, std::shared_ptr<void const> owner) : m_base{base}, m_base_owner{std::move(owner)} {}
+
+    size_t Size () const {return m_base.size() + m_size;}
+    bool Empty () const {return Size() == 0;}
+
+    glm::vec3 operator[] (size_t i) const
+    {
+        if(i < m_base.size())
+            return m_base[i];
+        i -= m_base.size();
+        return ChunkAt(i)->points[i & kMask];
+    }
+
+    /// Append a point. O(log n).
+    void PushBack (glm::vec3 const& p)
+    {
+        if(m_size == Capacity())
+        {
+            // Grow by one level, the old root becomes the first child of the new root.
+            if(m_root)
+            {
+                auto root = std::make_shared<Inner>();
+                root->children[0] = m_root;
+                m_root = root;
+                m_shift += kBits;
+            }
+            else
+                m_root = std::make_shared<Chunk>();
+        }
+        OwnChunk(m_size)->points[m_size & kMask] = p;
+        ++m_size;
+    }
+
+    /// Append several points. The path to a chunk is only walked once for all the points that go into it.
+    void Append (PointView points)
+    {
+        for(size_t k = 0; k < points.size(); )
+        {
+            PushBack(points[k++]);
+            Chunk* chunk = OwnChunk(m_size - 1);
+            for(; k < points.size() && (m_size & kMask) != 0; ++k)
+                chunk->points[m_size++ & kMask] = points[k];
+        }
+    }
+
+    /// Replace point i, i < Size(). O(log n), except that replacing a viewed point copies all of them first.
+    void Set (size_t i, glm::vec3 const& p)
+    {
+        if(i < m_base.size())
+            DropBase();
+        i -= m_base.size();
+        OwnChunk(i)->points[i & kMask] = p;
+    }
+
+    /// Drop points from the end, n <= Size().
+    /// Trailing chunks stay referenced until overwritten, which keeps this O(1).
+    void Truncate (size_t n)
+    {
+        if(n >= m_base.size())
+        {
+            m_size = std::min(n - m_base.size(), m_size);
+            return;
+        }
+        m_base = m_base.First(n);
+        m_root.reset();
+        m_size = 0;
+        m_shift = 0;
+    }
+
+    /// Number of leading points that are equal in both sequences. Subtrees shared between the two are skipped
+    /// without looking at their points, so comparing two versions of a history costs O(log n) per change. Viewed
+    /// points are compared one by one, unless both sequences view the same ones.
+    size_t CommonPrefix (PersistentPoints const& other) const
+    {
+        size_t limit = std::min(Size(), other.Size());
+        size_t n_base = m_base.size();
+        if(m_base.SameData(other.m_base) && n_base == other.m_base.size())
+            return limit <= n_base ? limit : n_base + TrieCommonPrefix(*this, other, limit - n_base);
+        if(n_base == 0 && other.m_base.size() == 0)
+            return TrieCommonPrefix(*this, other, limit);
+
+        size_t i = m_base.SameData(other.m_base) ? std::min(limit, std::min(n_base, other.m_base.size())) : 0;
+        while(i < limit && (*this)[i] == other[i])
+            ++i;
+        return i;
+    }
+
+    /// Bytes of RAM taken by the nodes of this sequence that are not in seen yet. Pass the same set for several
+    /// sequences to count the nodes they share once. Viewed points are not counted.
+    size_t Bytes (std::unordered_set<void const*>* seen) const {return Bytes(m_root.get(), m_shift, seen);}
+
+    /// Append points [first, Size()) to out.
+    void CopyTo (size_t first, std::vector<glm::vec3>* out) const
+    {
+        out->reserve(out->size() + Size() - std::min(first, Size()));
+        for(size_t i = first; i < m_base.size(); ++i)
+            out->push_back(m_base[i]);
+        first = first > m_base.size() ? first - m_base.size() : 0;
+        for(size_t i = first; i < m_size; )
+        {
+            auto const& points = ChunkAt(i)->points;
+            size_t end = std::min(m_size, (i | kMask) + 1);
+            out->insert(out->end(), points.begin() + (i & kMask), points.begin() + (end - ((i >> kBits) << kBits)));
+            i = end;
+        }
+    }
+};
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "point_view.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/// Point file format: a PointFileHeader, then the profile's x and y coordinates and the axis' x and y coordinates
+/// as four float arrays. Values are stored in host byte order.
+/// Columns of plain floats can be mapped into memory and viewed in place, so loading does not parse or copy.
+const char kPointFileMagic[4] = {'V', 'S', 'P', 'T'};
+const uint32_t kPointFileVersion = 1;
+
+struct PointFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t n_profile;
+    uint64_t n_axis;
+};
+
+/// A point file mapped into memory. The views it returns point into the mapping and are valid while it is open.
+class MappedPointFile
+{
+private:
+    char const* m_data = nullptr;
+    size_t m_size = 0;
+    PointFileHeader m_header;
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#endif
+
+    bool Map (std::string const& path);
+    void Unmap ();
+
+    /// Column i of profile x, profile y, axis x and axis y.
+    float const* Column (int i) const
+    {
+        size_t offset = sizeof(PointFileHeader);
+        for(int k = 0; k < i; ++k)
+            offset += (k < 2 ? m_header.n_profile : m_header.n_axis) * sizeof(float);
+        return reinterpret_cast<float const*>(m_data + offset);
+    }
+
+public:
+    explicit MappedPointFile (std::string const& path);
+    ~MappedPointFile () {Unmap();}
+    MappedPointFile (MappedPointFile const&) = delete;
+    MappedPointFile& operator= (MappedPointFile const&) = delete;
+
+    bool Good () const {return m_data != nullptr;}
+
+    PointView Profile () const {return Good() ? PointView(Column(0), Column(1), m_header.n_profile) : PointView();}
+    PointView Axis () const {return Good() ? PointView(Column(2), Column(3), m_header.n_axis) : PointView();}
+};
+
+inline MappedPointFile::MappedPointFile (std::string const& path)
+{
+    if(!Map(path))
+    {
+        std::cerr << "Could not map point file " << path << std::endl;
+        return;
+    }
+    if(m_size < sizeof(PointFileHeader))
+    {
+        std::cerr << path << " is not a point file" << std::endl;
+        Unmap();
+        return;
+    }
+    std::memcpy(&m_header, m_data, sizeof(m_header));
+    size_t max_points = (m_size - sizeof(PointFileHeader)) / (2 * sizeof(float));
+    if(std::memcmp(m_header.magic, kPointFileMagic, sizeof(kPointFileMagic)) != 0 || m_header.version != kPointFileVersion)
+    {
+        std::cerr << path << " is not a version " << kPointFileVersion << " point file" << std::endl;
+        Unmap();
+    }
+    else if(m_header.n_profile > max_points || m_header.n_axis > max_points - m_header.n_profile ||
+            m_size != sizeof(PointFileHeader) + 2 * (m_header.n_profile + m_header.n_axis) * sizeof(float))
+    {
+        std::cerr << path << " does not have the size its header says" << std::endl;
+        Unmap();
+    }
+}
+
+#ifdef _WIN32
+
+inline bool MappedPointFile::Map (std::string const& path)
+{
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER size;
+    if(m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+    {
+        Unmap();
+        return false;
+    }
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void const* data = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if(!data)
+    {
+        Unmap();
+        return false;
+    }
+    m_data = static_cast<char const*>(data);
+    m_size = size_t(size.QuadPart);
+    return true;
+}
+
+inline void MappedPointFile::Unmap ()
+{
+    if(m_data)
+        UnmapViewOfFile(m_data);
+    if(m_mapping)
+        CloseHandle(m_mapping);
+    if(m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+inline bool MappedPointFile::Map (std::string const& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    void* data = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size > 0)
+        data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file alive.
+    close(fd);
+    if(data == MAP_FAILED)
+        return false;
+    // The columns are read front to back when the curves are set and again whenever the solid is regenerated, so the
+    // pages should stay resident.
+    posix_madvise(data, size_t(st.st_size), POSIX_MADV_WILLNEED);
+    m_data = static_cast<char const*>(data);
+    m_size = size_t(st.st_size);
+    return true;
+}
+
+inline void MappedPointFile::Unmap ()
+{
+    if(m_data)
+        munmap(const_cast<char*>(m_data), m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+#endif
+
+/// Read "x,y" lines from a CSV file and write the x values to out and the y values to y_out, each as they come.
+/// Commas, semicolons, tabs and spaces separate the values. Empty lines, lines starting with '#' and a first line
+/// that is not a point (a column header) are skipped.
+/// \return Number of points, or -1 on a malformed line.
+inline long StreamCsvColumns (std::string const& path, std::istream& in, std::ostream& out, std::ostream& y_out)
+{
+    const size_t kChunk = 1 << 14;
+    std::vector<float> xs, ys;
+    xs.reserve(kChunk);
+    ys.reserve(kChunk);
+    auto flush = [&]()
+    {
+        out.write(reinterpret_cast<char const*>(xs.data()), xs.size() * sizeof(float));
+        y_out.write(reinterpret_cast<char const*>(ys.data()), ys.size() * sizeof(float));
+        xs.clear();
+        ys.clear();
+    };
+
+    long count = 0, line_no = 0;
+    std::string line;
+    while(std::getline(in, line))
+    {
+        ++line_no;
+        char const* c = line.c_str();
+        while(*c == ' ' || *c == '\t')
+            ++c;
+        if(*c == '\0' || *c == '\r' || *c == '#')
+            continue;
+
+        char* end;
+        float x = std::strtof(c, &end);
+        bool ok = end != c;
+        c = end;
+        while(*c == ',' || *c == ';' || *c == ' ' || *c == '\t')
+            ++c;
+        float y = std::strtof(c, &end);
+        ok = ok && end != c;
+        if(!ok)
+        {
+            if(count == 0 && line_no == 1)
+                continue;
+            std::cerr << path << ":" << line_no << ": expected two numbers" << std::endl;
+            return -1;
+        }
+
+        xs.push_back(x);
+        ys.push_back(y);
+        ++count;
+        if(xs.size() == kChunk)
+            flush();
+    }
+    flush();
+    return count;
+}
+
+/// Append the contents of the file at path to out.
+inline bool AppendFile (std::string const& path, std::ostream& out)
+{
+    std::ifstream in{path, std::ios::binary};
+    return in && (in.peek() == std::ifstream::traits_type::eof() || out << in.rdbuf());
+}
+
+/// Convert a profile and optionally an axis from CSV files with one "x,y" point per line to a point file.
+/// The CSV files are streamed: x values go straight to the output and y values to a temporary file next to it, which
+/// is appended after each curve. Memory use does not depend on the number of points.
+/// \param [in] axis_csv Empty for a file without axis.
+inline bool ConvertCsvToPointFile (std::string const& profile_csv, std::string const& axis_csv, std::string const& out_path)
+{
+    std::ofstream out{out_path, std::ios::binary};
+    if(!out)
+    {
+        std::cerr << "Could not open " << out_path << " for writing" << std::endl;
+        return false;
+    }
+    PointFileHeader header;
+    std::memcpy(header.magic, kPointFileMagic, sizeof(kPointFileMagic));
+    header.version = kPointFileVersion;
+    header.n_profile = header.n_axis = 0;
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+
+    std::string y_path = out_path + ".y";
+    bool ok = true;
+    for(int i = 0; ok && i < 2; ++i)
+    {
+        std::string const& csv = i == 0 ? profile_csv : axis_csv;
+        if(csv.empty())
+            continue;
+        std::ifstream in{csv};
+        if(!in)
+        {
+            std::cerr << "Could not open " << csv << std::endl;
+            ok = false;
+            break;
+        }
+        std::ofstream y_out{y_path, std::ios::binary | std::ios::trunc};
+        long count = StreamCsvColumns(csv, in, out, y_out);
+        y_out.close();
+        ok = count >= 0 && y_out && AppendFile(y_path, out);
+        (i == 0 ? header.n_profile : header.n_axis) = uint64_t(std::max(0L, count));
+    }
+    std::remove(y_path.c_str());
+
+    out.seekp(0);
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    out.close();
+    if(ok && !out)
+        std::cerr << "Could not write " << out_path << std::endl;
+    if(!ok || !out)
+    {
+        // Do not leave a file behind whose header does not match its data.
+        std::remove(out_path.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+/// Read only view of a sequence of points whose coordinates are stored elsewhere, with a stride between points.
+/// It views a std::vector<glm::vec3> as well as the separate x and y columns of a point file, so profiles can be
+/// handed to the revolver, the picker and Curve without first being copied into a vector.
+/// The viewed data must outlive the view.
+class PointView
+{
+private:
+    float const* m_x = nullptr;
+    float const* m_y = nullptr;
+    float const* m_z = nullptr; ///< nullptr for 2D points, whose z is 0.
+    size_t m_size = 0;
+    size_t m_stride = 1; ///< In floats.
+
+public:
+    PointView () {}
+
+    /// View 2D points stored as separate x and y arrays.
+    PointView (float const* x, float const* y, size_t size, size_t stride = 1)
+        : m_x{x}, m_y{y}, m_size{size}, m_stride{stride} {}
+
+    /// View a vector of points. Implicit, so functions taking a view also take vectors.
+    PointView (std::vector<glm::vec3> const& points)
+        : m_size{points.size()}, m_stride{3}
+    {
+        if(!points.empty())
+        {
+            m_x = &points[0].x;
+            m_y = &points[0].y;
+            m_z = &points[0].z;
+        }
+    }
+
+    size_t size () const {return m_size;}
+    bool empty () const {return m_size == 0;}
+
+    glm::vec3 operator[] (size_t i) const
+    {
+        return glm::vec3(m_x[i * m_stride], m_y[i * m_stride], m_z ? m_z[i * m_stride] : 0.0f);
+    }
+
+    glm::vec3 front () const {return (*this)[0];}
+    glm::vec3 back () const {return (*this)[m_size - 1];}
+
+    /// View of the first n points, n <= size().
+    PointView First (size_t n) const
+    {
+        PointView view = *this;
+        view.m_size = n;
+        return view;
+    }
+
+    /// Whether both view the same data, so the points they have in common are equal without comparing them.
+    bool SameData (PointView const& o) const {return m_x == o.m_x && m_y == o.m_y && m_z == o.m_z && m_stride == o.m_stride;}
+
+    /// Copy the points into a vector.
+    std::vector<glm::vec3> ToVector () const
+    {
+        std::vector<glm::vec3> points;
+        points.reserve(m_size);
+        for(size_t i = 0; i < m_size; ++i)
+            points.push_back((*this)[i]);
+        return points;
+    }
+};
@@ -0,0 +1,483 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "revolve.h"
+
+/// A ray in world space.
+struct Ray
+{
+    glm::vec3 origin;
+    glm::vec3 dir;
+};
+
+/// Build the world space ray through a point on screen.
+/// \param [in] ndc Point in [-1,1] coordinates, as computed in HandleMouse.
+/// \param [in] view_proj Projection * view (* model) matrix the scene was rendered with.
+inline Ray ScreenRay (glm::vec2 ndc, glm::mat4 const& view_proj)
+{
+    glm::mat4 inv = glm::inverse(view_proj);
+    glm::vec4 near = inv * glm::vec4(ndc.x, ndc.y, -1, 1);
+    glm::vec4 far = inv * glm::vec4(ndc.x, ndc.y, 1, 1);
+    glm::vec3 p0 = glm::vec3(near.x, near.y, near.z) / near.w;
+    glm::vec3 p1 = glm::vec3(far.x, far.y, far.z) / far.w;
+    return {p0, glm::normalize(p1 - p0)};
+}
+
+/// Result of a pick.
+struct ProfileHit
+{
+    bool hit = false;
+    int row = -1;       ///< Profile row, i.e. index into the profile curve.
+    int angle = -1;     ///< Angular index in [0, n_incs), matching the vertex layout of RevolveProfile.
+    float distance = 0; ///< Distance along the ray.
+    glm::vec3 point;    ///< World space hit point.
+};
+
+/// Picks revolved surfaces analytically instead of testing the ray against every triangle.
+///
+/// The world space ray is mapped into the (height along axis, distance to axis) plane of the profile and intersected
+/// with the profile segments there. Segments are indexed by height in a uniform bucket grid, so only segments within
+/// the height range where the ray passes close enough to the axis are tested.
+///
+/// Rows are revolved like in RevolveRow, see ProjectOntoAxis: rows beside the axis are rings around it, rows past its
+/// ends are tilted rings around the end, which the picker follows around the axis by their height and distance at
+/// each angle. Heights and distances are measured along and across the line through the first and last axis point.
+/// On a bent axis the centers of the rows are off that line, and each segment is followed around the mean center of
+/// its two rows, which matches the generated surface up to the difference in their offsets.
+class ProfilePicker
+{
+private:
+    typedef AxisRow Row;
+
+    /// Rows with |b| below this are followed as if they were tilted this much less, so each angle around the axis
+    /// meets them once.
+    static constexpr float kMinSpread = 1e-3f;
+
+    std::vector<Row> m_rows;
+    std::vector<glm::vec3> m_axis;
+    int m_n_incs = kRevolveIncrements;
+    glm::vec3 m_origin, m_dir, m_normal;
+    float m_max_radius = 0;
+    float m_min_r = 1, m_max_r = 1;
+
+    // Segment j connects row j to row j + 1 (wrapping like the mesh). Buckets over height hold segment ids.
+    float m_h_min = 0, m_bucket_size = 1;
+    std::vector<std::vector<unsigned>> m_buckets;
+    std::vector<float> m_bucket_outer, m_bucket_inner; ///< Radius bounds of the segments in each bucket.
+
+    /// Row of a profile point, see AxisRow.
+    Row MakeRow (std::vector<glm::vec3> const& axis_pos, glm::vec3 const& p) const
+    {
+        return MakeAxisRow(axis_pos, m_origin, m_dir, m_normal, p);
+    }
+
+    /// Add segment k to the buckets it spans, after all segments before it.
+    void AddSegment (unsigned k);
+
+    int Bucket (float h) const
+    {
+        int b = int((h - m_h_min) / m_bucket_size);
+        return std::max(0, std::min(int(m_buckets.size()) - 1, b));
+    }
+
+    static float Spread (Row const& rw)
+    {
+        float spread = float(kMinSpread);
+        return std::abs(rw.b) < spread ? (rw.b < 0 ? -spread : spread) : rw.b;
+    }
+
+    /// Revolution angle of the point of a row at angle phi around the axis, measured from m_normal towards z. Rows
+    /// on the far side of the axis measure it from -normal, see RevolveRow.
+    static double RowAngle (Row const& rw, double phi)
+    {
+        if(rw.a == 0)
+            return rw.b > 0 ? phi : M_PI - phi;
+        float b = Spread(rw);
+        return std::atan2(std::abs(b) * std::sin(phi), b < 0 ? -std::cos(phi) : std::cos(phi));
+    }
+
+    /// Height along the axis and distance to it of the point of a row at revolution angle t.
+    /// \param [in] r RevolveRadius(t).
+    static void RowPoint (Row const& rw, double t, double r, float* height, float* radius)
+    {
+        if(rw.a == 0)
+        {
+            *height = rw.h;
+            *radius = rw.rho * float(r);
+            return;
+        }
+        float b = Spread(rw), ct = float(std::cos(t)), st = float(std::sin(t));
+        *height = rw.h + rw.rho * float(r) * rw.a * ct;
+        *radius = rw.rho * float(r) * std::sqrt(b * b * ct * ct + st * st);
+    }
+
+    /// Height range swept by a row around the axis.
+    float RowBottom (Row const& rw) const {return rw.h - rw.rho * m_max_r * std::abs(rw.a);}
+    float RowTop (Row const& rw) const {return rw.h + rw.rho * m_max_r * std::abs(rw.a);}
+
+    /// Smallest and largest distance of a row to the axis line.
+    float RowInner (Row const& rw) const {return std::max(0.0f, rw.rho * m_min_r * std::abs(Spread(rw)) - std::abs(rw.u));}
+    float RowOuter (Row const& rw) const {return rw.rho * m_max_r + std::abs(rw.u);}
+
+    /// Point s of a ray in axis coordinates, relative to the mean center of the rows of segment k.
+    glm::vec3 SegmentPoint (glm::vec3 const& o, glm::vec3 const& d, unsigned k, float s) const
+    {
+        float u = 0.5f * (m_rows[k].u + m_rows[(k + 1) % m_rows.size()].u);
+        return o + s * d - glm::vec3(0, u, 0);
+    }
+
+    /// Does the ray stay outside radius outer or inside radius inner around the axis for s in [s0, s1]?
+    static bool MissesShell (glm::vec3 const& o, glm::vec3 const& d, float s0, float s1, float inner, float outer)
+    {
+        float qa = d.y * d.y + d.z * d.z, qb = 2 * (o.y * d.y + o.z * d.z), qc = o.y * o.y + o.z * o.z;
+        float s_min = qa > 0 ? std::max(s0, std::min(s1, -qb / (2 * qa))) : s0;
+        float q_min = (qa * s_min + qb) * s_min + qc;
+        float q_max = std::max((qa * s0 + qb) * s0 + qc, (qa * s1 + qb) * s1 + qc);
+        return q_min > outer * outer || q_max < inner * inner;
+    }
+
+    /// Signed distance of ray point s (in axis coordinates) from the line through segment k, in the plane of its angle
+    /// around the axis. The sign tells the sides apart, it is not inside or outside.
+    /// \param [out] t Revolution angle of the nearer row at that angle.
+    /// \param [out] lambda Position of the closest point along the segment, in [0, 1] on it.
+    float LineDistance (glm::vec3 const& o, glm::vec3 const& d, unsigned k, float s, double* t, float* lambda) const;
+
+    /// First ray parameter in [s_lo, s_hi] where the ray crosses the surface swept by segment k, or -1.
+    /// Within the segment the radius only depends on the angle through r(t), so the crossing is found by marching
+    /// the ray's height range over the segment and bisecting.
+    float MarchSegment (glm::vec3 const& o, glm::vec3 const& d, unsigned k, float s_lo, float s_hi, double* t, float* lambda) const;
+
+public:
+    ProfilePicker () {}
+
+    /// (Re)build the index for a profile and axis.
+    void Build (PointView curve_pos, std::vector<glm::vec3> const& axis_pos, int n_incs = kRevolveIncrements);
+
+    /// Update the index after the profile points from first_moved on moved, were added or were removed, see
+    /// RevolveUpdate. Only those rows and the segments next to them are redone, unless the axis changed or the
+    /// new rows no longer fit the buckets, which rebuilds the index. Call whenever the mesh is updated.
+    void Update (PointView curve_pos, std::vector<glm::vec3> const& axis_pos, int n_incs, size_t first_moved);
+
+    /// Drop the index, e.g. when the mesh is cleared.
+    void Clear () {m_rows.clear(); m_axis.clear(); m_buckets.clear(); m_bucket_outer.clear(); m_bucket_inner.clear();}
+
+    /// Bytes of RAM taken by the index.
+    size_t Bytes () const
+    {
+        size_t bytes = m_rows.capacity() * sizeof(Row) + m_axis.capacity() * sizeof(glm::vec3) +
+                       (m_bucket_outer.capacity() + m_bucket_inner.capacity()) * sizeof(float);
+        for(auto const& bucket: m_buckets)
+            bytes += sizeof(bucket) + bucket.capacity() * sizeof(unsigned);
+        return bytes;
+    }
+
+    bool Empty () const {return m_rows.empty();}
+
+    /// Find the first profile row hit by a world space ray.
+    ProfileHit Pick (Ray const& ray) const;
+
+    /// World space position of vertex (angle, row) of the revolved surface.
+    glm::vec3 SurfacePoint (int row, int angle) const;
+};
+
+inline void ProfilePicker::AddSegment (unsigned k)
+{
+    Row const& a = m_rows[k];
+    Row const& b = m_rows[(k + 1) % m_rows.size()];
+    int lo = Bucket(std::min(RowBottom(a), RowBottom(b))), hi = Bucket(std::max(RowTop(a), RowTop(b)));
+    for(int i = lo; i <= hi; ++i)
+    {
+        m_buckets[i].push_back(k);
+        m_bucket_outer[i] = std::max(m_bucket_outer[i], std::max(RowOuter(a), RowOuter(b)));
+        m_bucket_inner[i] = std::min(m_bucket_inner[i], std::min(RowInner(a), RowInner(b)));
+    }
+}
+
+inline void ProfilePicker::Build (PointView curve_pos, std::vector<glm::vec3> const& axis_pos, int n_incs)
+{
+    Clear();
+    m_n_incs = n_incs;
+    if(curve_pos.size() < 2 || axis_pos.size() < 2)
+        return;
+
+    m_origin = axis_pos.front();
+    m_dir = axis_pos.back() - axis_pos.front();
+    if(glm::length(m_dir) < 1e-6f)
+        return;
+    m_dir = glm::normalize(m_dir);
+    m_normal = glm::vec3(-m_dir.y, m_dir.x, 0);
+    m_axis = axis_pos;
+
+    m_min_r = FLT_MAX;
+    m_max_r = 0;
+    for(int i = 0; i < n_incs; ++i)
+    {
+        float r = float(RevolveRadius(2 * M_PI * i / n_incs));
+        m_max_r = std::max(m_max_r, r);
+        m_min_r = std::min(m_min_r, r);
+    }
+
+    m_rows.reserve(curve_pos.size());
+    m_max_radius = 0;
+    for(size_t i = 0; i < curve_pos.size(); ++i)
+    {
+        m_rows.push_back(MakeRow(axis_pos, curve_pos[i]));
+        m_max_radius = std::max(m_max_radius, RowOuter(m_rows.back()));
+    }
+
+    // Segments span the height ranges of both their rows.
+    float h_max = -FLT_MAX;
+    m_h_min = FLT_MAX;
+    for(Row const& row: m_rows)
+    {
+        m_h_min = std::min(m_h_min, RowBottom(row));
+        h_max = std::max(h_max, RowTop(row));
+    }
+
+    // About four segments per bucket for an evenly sampled profile.
+    size_t n_buckets = std::max<size_t>(1, m_rows.size() / 4);
+    m_bucket_size = std::max(1e-6f, (h_max - m_h_min) / n_buckets);
+    m_buckets.resize(n_buckets);
+    m_bucket_outer.assign(n_buckets, 0);
+    m_bucket_inner.assign(n_buckets, FLT_MAX);
+    for(unsigned k = 0; k < m_rows.size(); ++k)
+        AddSegment(k);
+}
+
+inline void ProfilePicker::Update (PointView curve_pos, std::vector<glm::vec3> const& axis_pos, int n_incs, size_t first_moved)
+{
+    size_t n_old = m_rows.size();
+    if(first_moved >= n_old && curve_pos.size() == n_old && axis_pos == m_axis && n_incs == m_n_incs)
+        return;
+    if(first_moved == 0 || n_old < 2 || curve_pos.size() < 2 || axis_pos != m_axis || n_incs != m_n_incs)
+    {
+        Build(curve_pos, axis_pos, n_incs);
+        return;
+    }
+
+    // The new rows have to fall within the height range of the buckets, and the buckets must not get crowded.
+    first_moved = std::min(first_moved, n_old);
+    float h_max = m_h_min + m_bucket_size * m_buckets.size();
+    std::vector<Row> rows;
+    rows.reserve(curve_pos.size() - first_moved);
+    for(size_t i = first_moved; i < curve_pos.size(); ++i)
+    {
+        rows.push_back(MakeRow(axis_pos, curve_pos[i]));
+        if(RowBottom(rows.back()) < m_h_min || RowTop(rows.back()) > h_max)
+        {
+            Build(curve_pos, axis_pos, n_incs);
+            return;
+        }
+    }
+    if(curve_pos.size() > 8 * m_buckets.size())
+    {
+        Build(curve_pos, axis_pos, n_incs);
+        return;
+    }
+
+    // Segments are added in order, so those from the one before the first moved row on, which includes the one
+    // wrapping around to row 0, are at the back of each bucket. The radius bounds are left as they were, they
+    // only need to hold.
+    unsigned k_first = unsigned(first_moved - 1);
+    for(auto& bucket: m_buckets)
+        while(!bucket.empty() && bucket.back() >= k_first)
+            bucket.pop_back();
+    m_rows.resize(first_moved);
+    for(Row const& row: rows)
+    {
+        m_rows.push_back(row);
+        m_max_radius = std::max(m_max_radius, RowOuter(row));
+    }
+    for(unsigned k = k_first; k < m_rows.size(); ++k)
+        AddSegment(k);
+}
+
+inline float ProfilePicker::LineDistance (glm::vec3 const& o, glm::vec3 const& d, unsigned k, float s, double* t, float* lambda) const
+{
+    Row const& a = m_rows[k];
+    Row const& b = m_rows[(k + 1) % m_rows.size()];
+    glm::vec3 p = SegmentPoint(o, d, k, s);
+    double phi = std::atan2(p.z, p.y);
+    double ta = RowAngle(a, phi), tb = RowAngle(b, phi);
+    double r_a = RevolveRadius(ta), r_b = tb == ta ? r_a : RevolveRadius(tb);
+    float ha, ra, hb, rb;
+    RowPoint(a, ta, r_a, &ha, &ra);
+    RowPoint(b, tb, r_b, &hb, &rb);
+
+    float ph = p.x, pr = std::sqrt(p.y * p.y + p.z * p.z);
+    float dh = hb - ha, dr = rb - ra, len2 = dh * dh + dr * dr;
+    *lambda = len2 > 0 ? ((ph - ha) * dh + (pr - ra) * dr) / len2 : 0;
+    *t = *lambda < 0.5f ? ta : tb;
+    return len2 > 0 ? (dh * (pr - ra) - dr * (ph - ha)) / std::sqrt(len2) : pr - ra;
+}
+
+inline float ProfilePicker::MarchSegment (glm::vec3 const& o, glm::vec3 const& d, unsigned k, float s_lo, float s_hi, double* t, float* lambda) const
+{
+    Row const& a = m_rows[k];
+    Row const& b = m_rows[(k + 1) % m_rows.size()];
+    float h_lo = std::min(RowBottom(a), RowBottom(b)), h_hi = std::max(RowTop(a), RowTop(b));
+
+    if(h_lo == h_hi)
+    {
+        // Flat ring: intersect with its plane and check the radius falls between the two ends.
+        if(d.x == 0)
+            return -1;
+        float s = (a.h - o.x) / d.x;
+        if(s < s_lo || s > s_hi)
+            return -1;
+        glm::vec3 p = SegmentPoint(o, d, k, s);
+        double phi = std::atan2(p.z, p.y), tb = RowAngle(b, phi);
+        float h, ra, rb, rho = std::sqrt(p.y * p.y + p.z * p.z);
+        *t = RowAngle(a, phi);
+        RowPoint(a, *t, RevolveRadius(*t), &h, &ra);
+        RowPoint(b, tb, RevolveRadius(tb), &h, &rb);
+        if(rho < std::min(ra, rb) || rho > std::max(ra, rb))
+            return -1;
+        *lambda = ra == rb ? 0 : (rho - ra) / (rb - ra);
+        if(*lambda >= 0.5f)
+            *t = tb;
+        return s;
+    }
+
+    // Part of the ray within the height range of the segment.
+    float s0 = s_lo, s1 = s_hi;
+    if(std::abs(d.x) > 1e-9f)
+    {
+        float sa = (h_lo - o.x) / d.x, sb = (h_hi - o.x) / d.x;
+        s0 = std::max(s0, std::min(sa, sb));
+        s1 = std::min(s1, std::max(sa, sb));
+    }
+    else if(o.x < h_lo || o.x > h_hi)
+        return -1;
+    if(s0 >= s1)
+        return -1;
+
+    // Skip the march when the ray stays outside the largest or inside the smallest shell of the segment.
+    if(MissesShell(o, d, s0, s1, std::min(RowInner(a), RowInner(b)), std::max(RowOuter(a), RowOuter(b))))
+        return -1;
+
+    // Step at about half the angular resolution of the surface, then bisect each crossing of the segment's line
+    // until one lies on the segment.
+    float rho = std::max(1e-4f, 0.5f * (a.rho + b.rho) * m_min_r);
+    int n_steps = std::max(8, std::min(256, int((s1 - s0) / (rho * float(M_PI) / m_n_incs))));
+    float step = (s1 - s0) / n_steps;
+    bool positive = LineDistance(o, d, k, s0, t, lambda) > 0;
+    float prev = s0;
+    for(int i = 1; i <= n_steps; ++i)
+    {
+        float s = s0 + i * step;
+        if((LineDistance(o, d, k, s, t, lambda) > 0) == positive)
+        {
+            prev = s;
+            continue;
+        }
+        float lo = prev, hi = s;
+        for(int iter = 0; iter < 20; ++iter)
+        {
+            float mid = 0.5f * (lo + hi);
+            ((LineDistance(o, d, k, mid, t, lambda) > 0) == positive ? lo : hi) = mid;
+        }
+        LineDistance(o, d, k, hi, t, lambda);
+        if(*lambda >= -1e-3f && *lambda <= 1 + 1e-3f)
+            return hi;
+        positive = !positive;
+        prev = s;
+    }
+    return -1;
+}
+
+inline ProfileHit ProfilePicker::Pick (Ray const& ray) const
+{
+    ProfileHit res;
+    if(m_rows.empty())
+        return res;
+
+    // Ray in axis coordinates (h, u, w).
+    glm::vec3 rel = ray.origin - m_origin, z(0, 0, 1);
+    glm::vec3 o(glm::dot(rel, m_dir), glm::dot(rel, m_normal), glm::dot(rel, z));
+    glm::vec3 d(glm::dot(ray.dir, m_dir), glm::dot(ray.dir, m_normal), glm::dot(ray.dir, z));
+
+    // Restrict to the part of the ray inside the bounding cylinder of the surface.
+    float s_lo = 0, s_hi = FLT_MAX;
+    float qa = d.y * d.y + d.z * d.z, qb = 2 * (o.y * d.y + o.z * d.z);
+    float qc = o.y * o.y + o.z * o.z - m_max_radius * m_max_radius;
+    if(qa > 1e-12f)
+    {
+        float disc = qb * qb - 4 * qa * qc;
+        if(disc < 0)
+            return res;
+        float sq = std::sqrt(disc);
+        s_lo = std::max(0.0f, (-qb - sq) / (2 * qa));
+        s_hi = (-qb + sq) / (2 * qa);
+        if(s_hi < 0)
+            return res;
+    }
+    else if(qc > 0)
+        return res;
+
+    int b_lo = 0, b_hi = int(m_buckets.size()) - 1;
+    if(qa > 1e-12f)
+    {
+        float h0 = o.x + s_lo * d.x, h1 = o.x + s_hi * d.x;
+        b_lo = Bucket(std::min(h0, h1));
+        b_hi = Bucket(std::max(h0, h1));
+    }
+    else
+    {
+        // Parallel to the axis, the ray stays inside the cylinder. Bound it by the profile's height range.
+        s_hi = std::abs(o.x - m_h_min) + m_bucket_size * m_buckets.size();
+    }
+
+    // Visit buckets in the order the ray passes through them, so the search can stop at the first hit. Segments
+    // spanning several buckets are tested per bucket, only over the part of the ray inside that bucket.
+    double inc = 2 * M_PI / m_n_incs;
+    bool ascending = d.x >= 0;
+    int n_buckets = int(m_buckets.size());
+    for(int i = 0; i <= b_hi - b_lo; ++i)
+    {
+        int bucket = ascending ? b_lo + i : b_hi - i;
+        float s_enter = s_lo, s_exit = s_hi;
+        if(std::abs(d.x) > 1e-9f)
+        {
+            // The first and last bucket are open ended, as Bucket clamps to them.
+            float h_bottom = bucket == 0 ? -FLT_MAX : m_h_min + bucket * m_bucket_size;
+            float h_top = bucket == n_buckets - 1 ? FLT_MAX : m_h_min + (bucket + 1) * m_bucket_size;
+            float sa = (h_bottom - o.x) / d.x, sb = (h_top - o.x) / d.x;
+            s_enter = std::max(s_lo, std::min(sa, sb));
+            s_exit = std::min(s_hi, std::max(sa, sb));
+        }
+        if(res.hit && s_enter > res.distance)
+            break;
+        if(s_enter > s_exit || MissesShell(o, d, s_enter, s_exit, m_bucket_inner[bucket], m_bucket_outer[bucket]))
+            continue;
+
+        for(unsigned k: m_buckets[bucket])
+        {
+            double t;
+            float lambda;
+            float s = MarchSegment(o, d, k, s_enter, res.hit ? std::min(res.distance, s_exit) : s_exit, &t, &lambda);
+            if(s < 0 || (res.hit && s >= res.distance))
+                continue;
+
+            res.hit = true;
+            res.distance = s;
+            res.point = ray.origin + s * ray.dir;
+            res.row = lambda < 0.5f ? int(k) : int((k + 1) % m_rows.size());
+            int angle = int(std::floor(t / inc + 0.5)) % m_n_incs;
+            res.angle = angle < 0 ? angle + m_n_incs : angle;
+        }
+    }
+    return res;
+}
+
+inline glm::vec3 ProfilePicker::SurfacePoint (int row, int angle) const
+{
+    Row const& rw = m_rows[row];
+    double t = 2 * M_PI * angle / m_n_incs;
+    float rho = rw.rho * float(RevolveRadius(t));
+    glm::vec3 center = m_origin + rw.h * m_dir + rw.u * m_normal, radial = rw.a * m_dir + rw.b * m_normal;
+    return center + rho * (float(cos(t)) * radial + glm::vec3(0, 0, float(sin(t))));
+}
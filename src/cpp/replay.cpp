@@ -0,0 +1,100 @@
+// Replays an event log recorded with `custom --record <file>` without a window and reports how long each event
+// took to handle, including revolving the solid. Sessions recorded once can then be used as benchmarks.
+//
+// Usage: replay <file> [--verbose] [--gpu-resident] [--no-gl-cache] [--load <point file>]
+// Sessions recorded with --load need the same point file to replay. --no-gl-cache passes every GL call through, to
+// compare the call counts with the GL state cache.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "event_bus.h"
+#include "events.h"
+#include "event_log.h"
+#include "gl_state.h"
+#include "vase_editor.h"
+
+int main(int argc, char** argv)
+{
+    bool verbose = false, caching = true, usage = argc < 2;
+    Residency residency = kKeepCpuCopy;
+    std::string load_path;
+    for(int i = 2; i < argc; ++i)
+    {
+        if(std::string(argv[i]) == "--verbose")
+            verbose = true;
+        else if(std::string(argv[i]) == "--gpu-resident")
+            residency = kGpuOnly;
+        else if(std::string(argv[i]) == "--no-gl-cache")
+            caching = false;
+        else if(std::string(argv[i]) == "--load" && i + 1 < argc)
+            load_path = argv[++i];
+        else
+            usage = true;
+    }
+    if(usage)
+    {
+        std::cerr << "Usage: " << argv[0] << " <event log> [--verbose] [--gpu-resident] [--no-gl-cache] [--load <point file>]" << std::endl;
+        return 1;
+    }
+
+    EventBus::CreateSingleton();
+    MockGlBackend* backend = new MockGlBackend;
+    GlState::CreateSingleton(std::unique_ptr<GlBackend>(backend));
+    GlState::SetCaching(caching);
+
+    EventCodec codec;
+    RegisterEvents(&codec);
+    std::vector<LoggedEvent> events;
+    if(!ReadEventLog(argv[1], codec, &events))
+        return 1;
+
+    VaseEditor editor;
+    editor.SetResidency(residency);
+    if(!load_path.empty())
+    {
+        auto start = std::chrono::steady_clock::now();
+        if(!editor.Load(load_path))
+            return 1;
+        std::printf("loaded %zu profile and %zu axis points in %.2f ms\n", editor.curve.Size(), editor.axis.Size(),
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    // Handling times in microseconds, by tag.
+    std::vector<std::vector<double>> latencies(256);
+    double total = 0;
+    for(auto const& ev: events)
+    {
+        auto start = std::chrono::steady_clock::now();
+        EventBus::Publish(ev.event, ev.entry->eid);
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        latencies[ev.entry->tag].push_back(us);
+        total += us;
+        if(verbose)
+            std::printf("frame %6u  %9.3f s  %-16s %10.1f us\n", ev.frame, ev.time, ev.entry->name.c_str(), us);
+    }
+
+    std::printf("%zu events in %u frames, %.2f s recorded, %.2f ms to replay\n", events.size(),
+                events.empty() ? 0 : events.back().frame, events.empty() ? 0.0f : events.back().time, total / 1000);
+    std::printf("%-16s %8s %12s %12s %12s %12s\n", "event", "count", "mean us", "median us", "p95 us", "max us");
+    for(auto const& entry: codec.Entries())
+    {
+        auto& us = latencies[entry.tag];
+        if(us.empty())
+            continue;
+        std::sort(us.begin(), us.end());
+        double sum = 0;
+        for(double x: us)
+            sum += x;
+        std::printf("%-16s %8zu %12.1f %12.1f %12.1f %12.1f\n", entry.name.c_str(), us.size(), sum / us.size(),
+                    us[us.size() / 2], us[std::min(us.size() - 1, us.size() * 95 / 100)], us.back());
+    }
+
+    std::printf("profile %zu points, axis %zu points, solid %s, %zu GL calls\n", editor.curve.Size(), editor.axis.Size(),
+                editor.mesh.Empty() ? "not generated" : "generated", backend->Total());
+    MemoryUsage memory = editor.Memory();
+    std::printf("memory: %.1f KiB in RAM, %.1f KiB on the GPU\n", memory.cpu_bytes / 1024.0, memory.gpu_bytes / 1024.0);
+    GlState::PrintStats(std::cout);
+}
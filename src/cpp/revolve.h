@@ -0,0 +1,279 @@
+#pragma once
+
+#include <vector>
+#include <unordered_set>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtx/norm.hpp>
+#include "point_view.h"
+#include "persistent_points.h"
+
+/// Number of angular steps a profile is revolved in.
+const int kRevolveIncrements = 100;
+
+/// Radius multiplier of the revolved surface at revolution angle t.
+inline double RevolveRadius (double t)
+{
+    return 3 + (1/4.0) * std::tanh(4 * sin(12 * t));
+//    return 1;
+}
+
+inline std::pair<float, glm::vec2> minimum_distance(glm::vec2 v, glm::vec2 w, glm::vec2 p)
+{
+  // Consider the line extending the segment, parameterized as v + t (w - v).
+  // We find projection of point p onto the line.
+  // It falls where t = [(p-v) . (w-v)] / |w-v|^2
+  // We clamp t from [0,1] to handle points outside the segment vw.
+  const float l2 = glm::distance2(v, w);  // i.e. |w-v|^2 -  avoid a sqrt
+  const float t = std::max(0.0f, std::min(1.0f, glm::dot(p - v, w - v) / l2));
+  const glm::vec2 projection = v + t * (w - v);  // Projection falls on the segment
+  return std::make_pair(glm::distance(p, projection), projection);
+}
+
+inline std::pair<float, glm::vec2> minimum_distance(std::vector<glm::vec3> const& curve_2d, glm::vec2 p)
+{
+    float min_dist = FLT_MAX;
+    std::pair<float, glm::vec2> res;
+    for(size_t i = 0; i + 1 < curve_2d.size(); ++i)
+    {
+        glm::vec2 v(curve_2d[i]);
+        glm::vec2 w(curve_2d[i+1]);
+        auto pr = minimum_distance(v, w, p);
+        if(pr.first < min_dist)
+		{
+            res = pr;
+			min_dist = pr.first;
+		}
+    }
+    return res;
+}
+
+/// Where a profile point is revolved: around its closest point on the axis. Points past the ends of the axis are
+/// revolved around the end, so their rows are tilted against the axis.
+struct AxisProjection
+{
+    glm::vec3 center; ///< Closest point on the axis.
+    glm::vec3 radial; ///< Unit vector from the center towards the profile point, in the drawing plane.
+    float distance;   ///< Distance of the profile point from the center.
+};
+
+inline AxisProjection ProjectOntoAxis (std::vector<glm::vec3> const& axis_pos, glm::vec3 const& p)
+{
+    auto pr = minimum_distance(axis_pos, glm::vec2(p.x, p.y));
+    AxisProjection res;
+    res.center = glm::vec3(pr.second, 0);
+    res.distance = pr.first;
+    // Points on the axis collapse to the center, whichever way they are revolved.
+    res.radial = pr.first > 0 ? (p - res.center) / pr.first : glm::vec3(0, 1, 0);
+    return res;
+}
+
+/// A profile point as revolved by RevolveRow, in the frame of the line through the first and last axis point, with
+/// height along dir and offset along normal = (-dir.y, dir.x, 0). Its revolved point at angle t with radius multiplier
+/// r is at height h + rho r a cos(t), offset u + rho r b cos(t) and z rho r sin(t).
+struct AxisRow
+{
+    float h;    ///< Height of the center of revolution along the axis.
+    float u;    ///< Offset of the center from the axis line along normal, nonzero only for bent axes.
+    float rho;  ///< Distance from the center.
+    float a, b; ///< Direction from the center towards the profile point, along dir and normal. Rows past the ends of
+                ///< the axis or beside a bent part of it are tilted, a != 0.
+};
+
+inline AxisRow MakeAxisRow (std::vector<glm::vec3> const& axis_pos, glm::vec3 const& origin, glm::vec3 const& dir,
+                            glm::vec3 const& normal, glm::vec3 const& p)
+{
+    AxisProjection pr = ProjectOntoAxis(axis_pos, p);
+    AxisRow row;
+    row.h = glm::dot(pr.center - origin, dir);
+    row.u = glm::dot(pr.center - origin, normal);
+    row.rho = pr.distance;
+    row.a = glm::dot(pr.radial, dir);
+    row.b = glm::dot(pr.radial, normal);
+    if(std::abs(row.a) < 1e-6f)
+    {
+        // Beside a straight axis: a plain ring, which is cheaper to follow.
+        row.a = 0;
+        row.b = row.b < 0 ? -1.0f : 1.0f;
+    }
+    return row;
+}
+
+/// Revolve a single profile point: fill n_incs positions and normals.
+/// \param [in] p_prev, p, p_next The profile point and its neighbours, which determine its normal.
+inline void RevolveRow (glm::vec3 const& p_prev, glm::vec3 const& p, glm::vec3 const& p_next,
+                        std::vector<glm::vec3> const& axis_pos, int n_incs, glm::vec3* pos_it, glm::vec3* norm_it)
+{
+    double inc = 2 * M_PI / n_incs;
+
+    // Get normal vector to p - p_next and p_prev - p by rotating by 90 degrees (x, y) -> (-y, x).
+    auto nm_next = glm::vec2(p_next.y - p.y, p.x - p_next.x);
+    auto nm_prev = glm::vec2(p.y - p_prev.y, p_prev.x - p.x);
+
+    // Average normals to get this point's normal.
+    auto nm = 0.5f * (nm_next + nm_prev);
+
+    // Rotate p around its projection onto the axis, in the plane of the direction away from the axis and z.
+    AxisProjection pr = ProjectOntoAxis(axis_pos, p);
+
+    for(int i = 0; i < n_incs; ++i)
+    {
+        double t{inc * i};
+        double r = RevolveRadius(t);
+        *pos_it++ = pr.center + float(r * pr.distance) * (float(cos(t)) * pr.radial + glm::vec3(0, 0, float(sin(t))));
+
+        // Set normal by applying rotation to 2d normal.
+        *norm_it++ = glm::normalize(glm::vec3{nm.x * r * cos(t), nm.y, nm.x * r * sin(t)});
+    }
+}
+
+/// Rows of a revolved profile that changed since the previous call to ProfileRevolver::Revolve.
+/// Vertex (i, j) is angular step i of profile row j at index j * n_incs + i, triangle indices of row j are
+/// [6 * n_incs * j, 6 * n_incs * (j + 1)).
+struct RevolveUpdate
+{
+    /// Rows [first, end) whose vertices were recomputed.
+    struct Range
+    {
+        size_t first, end;
+    };
+
+    size_t n_rows = 0;
+    int n_incs = 0;
+    std::vector<Range> ranges;                      ///< Sorted, disjoint and not adjacent.
+    std::vector<glm::vec3> positions, normals, uvs; ///< Vertices of the recomputed rows, range after range.
+    size_t first_moved = 0;      ///< First profile point that moved, was added or was removed. n_rows if none did.
+    size_t first_index_row = 0;  ///< Triangle indices of rows from this one on changed. n_rows if none did.
+    std::vector<unsigned> indices; ///< Triangle indices of rows [first_index_row, n_rows).
+
+    bool Empty () const {return ranges.empty() && first_index_row == n_rows;}
+};
+
+/// Revolves a 2D profile around a 2D axis curve.
+/// Every profile point is rotated around its projection onto the axis, in the plane spanned by the direction away
+/// from the axis and the z axis. The profile is treated as closed, so the last row connects back to the first.
+///
+/// Only the profile points the rows of the last call were computed from are kept, not the rows themselves, which
+/// live in the Mesh. They are kept as a PersistentPoints copy, which shares its nodes with the undo history it came
+/// from. When the same revolver is called again with an edited profile and the same axis, only rows whose point or
+/// neighbours changed are recomputed and returned; the unchanged front of the profile is skipped without looking at
+/// its points. Texture coordinates hold the raw angular step and
+/// row, so appending rows leaves the others alone; the shader scales them to the row count.
+class ProfileRevolver
+{
+private:
+    PersistentPoints m_points;
+    std::vector<glm::vec3> m_axis;
+    int m_n_incs = 0;
+
+public:
+    /// \param [in] curve_pos Profile points, e.g. the working state of an EditHistory.
+    /// \param [in] axis_pos Axis points.
+    /// \param [in] n_incs Angular steps per row.
+    /// \param [out] update Rows and triangle indices that changed since the last call, all of them on the first.
+    void Revolve (PersistentPoints const& curve_pos, std::vector<glm::vec3> const& axis_pos, int n_incs, RevolveUpdate* update);
+
+    /// Revolve profile points viewed elsewhere, e.g. a vector or the columns of a mapped point file. They are copied.
+    void Revolve (PointView curve_pos, std::vector<glm::vec3> const& axis_pos, int n_incs, RevolveUpdate* update)
+    {
+        Revolve(PersistentPoints(curve_pos), axis_pos, n_incs, update);
+    }
+
+    /// Bytes of RAM taken by the points of the last call, not counting profile nodes that are in seen already.
+    size_t Bytes (std::unordered_set<void const*>* seen) const
+    {
+        return m_points.Bytes(seen) + m_axis.capacity() * sizeof(glm::vec3);
+    }
+
+    /// Forget the last call, so the next one returns all rows.
+    void Clear ()
+    {
+        m_points = PersistentPoints();
+        m_axis.clear();
+    }
+};
+
+inline void ProfileRevolver::Revolve (PersistentPoints const& curve_pos, std::vector<glm::vec3> const& axis_pos, int n_incs,
+                                      RevolveUpdate* update)
+{
+    if(n_incs != m_n_incs || axis_pos != m_axis)
+    {
+        Clear();
+        m_axis = axis_pos;
+        m_n_incs = n_incs;
+    }
+
+    // Rows are matched by index, so edits at the end of the profile (drawing, undo, redo) keep the rows before them.
+    size_t n_rows = curve_pos.Size(), n_old = m_points.Size(), n_cached = std::min(n_rows, n_old);
+    size_t prefix = curve_pos.CommonPrefix(m_points);
+    update->n_rows = n_rows;
+    update->n_incs = n_incs;
+    update->ranges.clear();
+    update->positions.clear();
+    update->normals.clear();
+    update->uvs.clear();
+    update->first_moved = n_rows == n_old ? n_rows : n_cached;
+    for(size_t j = 0; j < n_rows; ++j)
+    {
+        // Rows [1, prefix - 1) keep their point and both neighbours. The first row does not if the last point
+        // changed, its previous point wraps around to it.
+        if(j == 1 && prefix > 2)
+            j = prefix - 1;
+
+        // A row depends on its point and both neighbours.
+        glm::vec3 p_prev = curve_pos[(j + n_rows - 1) % n_rows], p = curve_pos[j], p_next = curve_pos[(j + 1) % n_rows];
+        if(j < n_cached && p == m_points[j] && p_prev == m_points[(j + n_old - 1) % n_old] &&
+           p_next == m_points[(j + 1) % n_old])
+            continue;
+        if(j < n_cached && p != m_points[j])
+            update->first_moved = std::min(update->first_moved, j);
+
+        if(!update->ranges.empty() && update->ranges.back().end == j)
+            update->ranges.back().end = j + 1;
+        else
+            update->ranges.push_back({j, j + 1});
+        size_t first = update->positions.size();
+        update->positions.resize(first + n_incs);
+        update->normals.resize(first + n_incs);
+        RevolveRow(p_prev, p, p_next, m_axis, n_incs, &update->positions[first], &update->normals[first]);
+        for(int i = 0; i < n_incs; ++i)
+            update->uvs.push_back(glm::vec3(i, j, 0));
+    }
+    m_points = curve_pos;
+
+    // Rows connect to the next one, and the last one back to the first, so a changed row count changes the indices
+    // from the old last row on.
+    update->first_index_row = n_rows == n_old ? n_rows : n_cached > 0 ? n_cached - 1 : 0;
+    update->indices.clear();
+    for(size_t j = update->first_index_row; j < n_rows; ++j)
+    {
+        for(int i = 0; i < n_incs; ++i)
+        {
+            #define T2to1(i, j) unsigned(((j) % n_rows) * n_incs + (i) % n_incs)
+            update->indices.push_back(T2to1(i, j));
+            update->indices.push_back(T2to1(i+1, j));
+            update->indices.push_back(T2to1(i, j+1));
+
+            update->indices.push_back(T2to1(i+1, j+1));
+            update->indices.push_back(T2to1(i, j+1));
+            update->indices.push_back(T2to1(i+1, j));
+            #undef T2to1
+        }
+    }
+}
+
+/// Revolve a profile without caching, see ProfileRevolver.
+/// \param [out] mesh_pos Positions, followed by normals, followed by uvs.
+/// \param [out] mesh_inds Triangle indices.
+inline void RevolveProfile (PointView curve_pos, std::vector<glm::vec3> const& axis_pos, int n_incs,
+                            std::vector<glm::vec3>* mesh_pos, std::vector<unsigned>* mesh_inds)
+{
+    RevolveUpdate update;
+    ProfileRevolver().Revolve(curve_pos, axis_pos, n_incs, &update);
+    *mesh_pos = std::move(update.positions);
+    mesh_pos->insert(mesh_pos->end(), update.normals.begin(), update.normals.end());
+    mesh_pos->insert(mesh_pos->end(), update.uvs.begin(), update.uvs.end());
+    *mesh_inds = std::move(update.indices);
+}
@@ -0,0 +1,433 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cfloat>
+#include <glm/glm.hpp>
+
+/// Two triangles whose interiors cross. Triangles are numbered by their position in the index buffer (offset / 3).
+struct TrianglePair
+{
+    unsigned a, b;
+};
+
+/// Result of a self intersection check.
+struct IntersectionReport
+{
+    std::vector<TrianglePair> pairs;
+
+    /// Profile rows that own a vertex of an intersecting triangle, sorted and unique.
+    std::vector<unsigned> rows;
+
+    bool Empty () const {return pairs.empty();}
+};
+
+/// Finds intersecting pairs of non-adjacent triangles in an indexed triangle mesh.
+///
+/// Triangles are split into blocks of consecutive triangles. Each block has a bounding volume hierarchy over the
+/// boxes of its triangles, grouped in index buffer order: meshes built row by row, like revolved profiles, already
+/// keep neighbouring triangles together, and measured faster this way than sorted along a Morton curve. Boxes follow
+/// the triangles, so the long thin triangles of a finely revolved profile only meet the few boxes they overlap, where
+/// a uniform grid needs one cell size for all of them. Pairs of blocks whose roots overlap are walked down together,
+/// which visits each overlapping pair of nodes once, and the block pairs are shared out to threads.
+///
+/// The checker keeps its blocks and the pairs it found between checks. Blocks whose triangles were invalidated
+/// since the last check are rebuilt and only block pairs involving them are walked again, so checking after an
+/// edit costs about as much as the edit changed.
+class SelfIntersectionChecker
+{
+private:
+    struct Box
+    {
+        glm::vec3 lo, hi;
+
+        bool Overlaps (Box const& o) const
+        {
+            return lo.x <= o.hi.x && o.lo.x <= hi.x && lo.y <= o.hi.y && o.lo.y <= hi.y && lo.z <= o.hi.z && o.lo.z <= hi.z;
+        }
+
+        void Extend (Box const& o)
+        {
+            lo = glm::min(lo, o.lo);
+            hi = glm::max(hi, o.hi);
+        }
+    };
+
+    /// Hierarchy over a sequence of boxes: node k of levels[0] bounds boxes [kFanout * k, kFanout * (k + 1)), node k of
+    /// each level above bounds the same range of nodes of the level below. levels.back() is the root.
+    struct Tree
+    {
+        std::vector<std::vector<Box>> levels;
+
+        void Build (std::vector<Box> const& boxes);
+    };
+
+    /// Triangles [first, first + kBlockSize). boxes[k] is the box of triangle first + k.
+    struct Block
+    {
+        size_t first;
+        std::vector<Box> boxes;
+        Tree tree;
+        bool stale = true; ///< Triangles changed since the block was built.
+
+        Box const& Root () const {return tree.levels.back()[0];}
+    };
+
+    /// A node of a block's tree.
+    struct NodeRef
+    {
+        uint32_t block;
+        int32_t level;
+        uint32_t node;
+    };
+
+    /// Two nodes whose triangles are tested against each other, or a node whose triangles are tested among
+    /// themselves if both are the same.
+    struct Task
+    {
+        NodeRef x, y;
+    };
+
+    static const size_t kFanout = 4;
+    static const size_t kBlockSize = 4096;
+
+    // The mesh being checked, only set during Check.
+    std::vector<glm::vec3> const* m_positions = nullptr;
+    std::vector<unsigned> const* m_indices = nullptr;
+    size_t m_n_tris = 0;
+    std::vector<Block> m_blocks;
+    std::vector<TrianglePair> m_pairs; ///< Found by the last check, sorted.
+
+    glm::vec3 const& Vertex (size_t tri, int k) const {return (*m_positions)[(*m_indices)[3 * tri + k]];}
+
+    /// Degenerate triangles get an empty box, so they overlap nothing and are never tested.
+    Box TriangleBox (size_t tri) const
+    {
+        glm::vec3 const& a = Vertex(tri, 0);
+        glm::vec3 const& b = Vertex(tri, 1);
+        glm::vec3 const& c = Vertex(tri, 2);
+        if(IsDegenerate(a, b, c))
+            return {glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+        return {glm::min(glm::min(a, b), c), glm::max(glm::max(a, b), c)};
+    }
+
+    Box const& NodeBox (NodeRef n) const {return m_blocks[n.block].tree.levels[n.level][n.node];}
+
+    /// Number of children of a node, which are nodes one level down or triangles of a leaf.
+    size_t ChildCount (NodeRef n) const
+    {
+        Block const& block = m_blocks[n.block];
+        size_t below = n.level == 0 ? block.boxes.size() : block.tree.levels[n.level - 1].size();
+        return std::min(below - n.node * kFanout, size_t(kFanout));
+    }
+
+    static NodeRef Child (NodeRef n, size_t i) {return {n.block, n.level - 1, uint32_t(n.node * kFanout + i)};}
+
+    static bool IsDegenerate (glm::vec3 const& a, glm::vec3 const& b, glm::vec3 const& c)
+    {
+        glm::vec3 n = glm::cross(b - a, c - a);
+        return glm::dot(n, n) < 1e-20f;
+    }
+
+    /// Does the open segment (p, q) pass through the interior of triangle (a, b, c)? Möller-Trumbore, with
+    /// touching at edges and endpoints not counted, so neighbours meeting at a seam do not report.
+    static bool SegmentCrossesTriangle (glm::vec3 const& p, glm::vec3 const& q,
+                                        glm::vec3 const& a, glm::vec3 const& b, glm::vec3 const& c)
+    {
+        const float eps = 1e-6f;
+        glm::vec3 dir = q - p;
+        glm::vec3 e1 = b - a, e2 = c - a;
+        glm::vec3 pv = glm::cross(dir, e2);
+        float det = glm::dot(e1, pv);
+        if(std::abs(det) < 1e-12f) // Parallel or coplanar.
+            return false;
+        float inv = 1.0f / det;
+        glm::vec3 tv = p - a;
+        float u = glm::dot(tv, pv) * inv;
+        if(u <= eps || u >= 1 - eps)
+            return false;
+        glm::vec3 qv = glm::cross(tv, e1);
+        float v = glm::dot(dir, qv) * inv;
+        if(v <= eps || u + v >= 1 - eps)
+            return false;
+        float t = glm::dot(e2, qv) * inv;
+        return t > eps && t < 1 - eps;
+    }
+
+    /// Are all vertices of b strictly on one side of the plane of a?
+    static bool OnOneSide (glm::vec3 const* a, glm::vec3 const* b)
+    {
+        glm::vec3 n = glm::cross(a[1] - a[0], a[2] - a[0]);
+        float d0 = glm::dot(n, b[0] - a[0]), d1 = glm::dot(n, b[1] - a[0]), d2 = glm::dot(n, b[2] - a[0]);
+        return (d0 > 0 && d1 > 0 && d2 > 0) || (d0 < 0 && d1 < 0 && d2 < 0);
+    }
+
+    bool TrianglesIntersect (size_t s, size_t t) const
+    {
+        glm::vec3 a[3] = {Vertex(s, 0), Vertex(s, 1), Vertex(s, 2)};
+        glm::vec3 b[3] = {Vertex(t, 0), Vertex(t, 1), Vertex(t, 2)};
+        if(OnOneSide(a, b) || OnOneSide(b, a))
+            return false;
+        for(int k = 0; k < 3; ++k)
+        {
+            if(SegmentCrossesTriangle(a[k], a[(k + 1) % 3], b[0], b[1], b[2]))
+                return true;
+            if(SegmentCrossesTriangle(b[k], b[(k + 1) % 3], a[0], a[1], a[2]))
+                return true;
+        }
+        return false;
+    }
+
+    bool ShareVertex (size_t s, size_t t) const
+    {
+        for(int i = 0; i < 3; ++i)
+            for(int j = 0; j < 3; ++j)
+                if((*m_indices)[3 * s + i] == (*m_indices)[3 * t + j])
+                    return true;
+        return false;
+    }
+
+    void BuildBlock (Block* block) const;
+    void BuildStaleBlocks (unsigned n_threads);
+    void Walk (Task task, std::vector<Task>* stack, std::vector<TrianglePair>* out) const;
+    void WalkBlockPairs (std::vector<TrianglePair> const* block_pairs, std::atomic<size_t>* next, std::vector<TrianglePair>* out) const;
+
+public:
+    /// Mark triangles [first, end) as changed since the last check. Triangles added or removed since then need not
+    /// be marked.
+    void Invalidate (size_t first, size_t end)
+    {
+        for(size_t b = first / kBlockSize; b < m_blocks.size() && b * kBlockSize < end; ++b)
+            m_blocks[b].stale = true;
+    }
+
+    /// Check the mesh, reusing what the last check found for triangles that were not invalidated since.
+    /// \param [in] positions Vertex positions. Only entries referenced by indices are read, so the packed
+    ///                       position/normal/uv layout of RevolveProfile can be passed directly.
+    /// \param [in] indices Triangle list indices.
+    /// \param [in] row_size Number of vertices per profile row, used to map vertices back to rows.
+    /// \param [in] n_threads Worker count. 0 picks the hardware concurrency.
+    IntersectionReport Check (std::vector<glm::vec3> const& positions, std::vector<unsigned> const& indices,
+                              unsigned row_size, unsigned n_threads = 0);
+
+    /// Forget the last check and free its memory, so the next one checks everything.
+    void Clear ()
+    {
+        std::vector<Block>().swap(m_blocks);
+        std::vector<TrianglePair>().swap(m_pairs);
+        m_n_tris = 0;
+    }
+
+    /// Bytes of RAM taken by the blocks and the pairs found.
+    size_t Bytes () const
+    {
+        size_t bytes = m_blocks.capacity() * sizeof(Block) + m_pairs.capacity() * sizeof(TrianglePair);
+        for(auto const& block: m_blocks)
+        {
+            bytes += block.boxes.capacity() * sizeof(Box);
+            for(auto const& level: block.tree.levels)
+                bytes += sizeof(level) + level.capacity() * sizeof(Box);
+        }
+        return bytes;
+    }
+};
+
+inline void SelfIntersectionChecker::Tree::Build (std::vector<Box> const& boxes)
+{
+    levels.clear();
+    std::vector<Box> const* below = &boxes;
+    do
+    {
+        std::vector<Box> level((below->size() + kFanout - 1) / kFanout);
+        for(size_t k = 0; k < below->size(); ++k)
+        {
+            if(k % kFanout == 0)
+                level[k / kFanout] = (*below)[k];
+            else
+                level[k / kFanout].Extend((*below)[k]);
+        }
+        levels.push_back(std::move(level));
+        below = &levels.back();
+    }
+    while(below->size() > 1);
+}
+
+inline void SelfIntersectionChecker::BuildBlock (Block* block) const
+{
+    size_t count = std::min(size_t(kBlockSize), m_n_tris - block->first);
+    block->boxes.resize(count);
+    for(size_t k = 0; k < count; ++k)
+        block->boxes[k] = TriangleBox(block->first + k);
+    block->tree.Build(block->boxes);
+}
+
+inline void SelfIntersectionChecker::BuildStaleBlocks (unsigned n_threads)
+{
+    std::vector<Block*> stale;
+    for(auto& block: m_blocks)
+        if(block.stale)
+            stale.push_back(&block);
+
+    if(n_threads == 0)
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = unsigned(std::min<size_t>(n_threads, stale.size()));
+    std::vector<std::thread> workers;
+    for(unsigned i = 0; i < n_threads; ++i)
+        workers.emplace_back([this, &stale, i, n_threads]()
+        {
+            for(size_t b = i; b < stale.size(); b += n_threads)
+                BuildBlock(stale[b]);
+        });
+    for(auto& worker: workers)
+        worker.join();
+}
+
+inline void SelfIntersectionChecker::Walk (Task task, std::vector<Task>* stack, std::vector<TrianglePair>* out) const
+{
+    stack->assign(1, task);
+    while(!stack->empty())
+    {
+        NodeRef x = stack->back().x, y = stack->back().y;
+        stack->pop_back();
+        bool same = x.block == y.block && x.level == y.level && x.node == y.node;
+
+        if(x.level == 0 && y.level == 0)
+        {
+            // Two leaves: test their triangles directly.
+            Block const& bx = m_blocks[x.block];
+            Block const& by = m_blocks[y.block];
+            Box const& box_y = NodeBox(y);
+            size_t nx = ChildCount(x), ny = ChildCount(y);
+            for(size_t i = 0; i < nx; ++i)
+            {
+                size_t ix = x.node * kFanout + i;
+                if(!same && !bx.boxes[ix].Overlaps(box_y))
+                    continue;
+                for(size_t j = same ? i + 1 : 0; j < ny; ++j)
+                {
+                    size_t iy = y.node * kFanout + j;
+                    if(!bx.boxes[ix].Overlaps(by.boxes[iy]))
+                        continue;
+                    size_t s = bx.first + ix, t = by.first + iy;
+                    if(!ShareVertex(s, t) && TrianglesIntersect(s, t))
+                        out->push_back({unsigned(std::min(s, t)), unsigned(std::max(s, t))});
+                }
+            }
+        }
+        else if(same)
+        {
+            // Pairs within a node: within each child, and between each two children.
+            size_t n = ChildCount(x);
+            for(size_t i = 0; i < n; ++i)
+            {
+                NodeRef ci = Child(x, i);
+                stack->push_back({ci, ci});
+                for(size_t j = i + 1; j < n; ++j)
+                {
+                    NodeRef cj = Child(x, j);
+                    if(NodeBox(ci).Overlaps(NodeBox(cj)))
+                        stack->push_back({ci, cj});
+                }
+            }
+        }
+        else
+        {
+            // Split the node that is higher up. Leaves are only paired with leaves.
+            if(x.level < y.level)
+                std::swap(x, y);
+            Box const& other = NodeBox(y);
+            size_t n = ChildCount(x);
+            for(size_t i = 0; i < n; ++i)
+            {
+                NodeRef c = Child(x, i);
+                if(NodeBox(c).Overlaps(other))
+                    stack->push_back({c, y});
+            }
+        }
+    }
+}
+
+inline void SelfIntersectionChecker::WalkBlockPairs (std::vector<TrianglePair> const* block_pairs, std::atomic<size_t>* next, std::vector<TrianglePair>* out) const
+{
+    std::vector<Task> stack;
+    for(size_t k = (*next)++; k < block_pairs->size(); k = (*next)++)
+    {
+        TrianglePair const& p = (*block_pairs)[k];
+        NodeRef x = {p.a, int32_t(m_blocks[p.a].tree.levels.size()) - 1, 0};
+        NodeRef y = {p.b, int32_t(m_blocks[p.b].tree.levels.size()) - 1, 0};
+        Walk({x, y}, &stack, out);
+    }
+}
+
+inline IntersectionReport SelfIntersectionChecker::Check (std::vector<glm::vec3> const& positions, std::vector<unsigned> const& indices,
+                                                          unsigned row_size, unsigned n_threads)
+{
+    m_positions = &positions;
+    m_indices = &indices;
+
+    // Blocks that were added, or whose number of triangles changed, are stale too.
+    size_t n_tris = indices.size() / 3;
+    size_t n_blocks = (n_tris + kBlockSize - 1) / kBlockSize;
+    m_n_tris = n_tris;
+    m_blocks.resize(n_blocks);
+    for(size_t b = 0; b < n_blocks; ++b)
+    {
+        m_blocks[b].first = b * kBlockSize;
+        if(m_blocks[b].boxes.size() != std::min(size_t(kBlockSize), n_tris - b * kBlockSize))
+            m_blocks[b].stale = true;
+    }
+
+    // Pairs among blocks that stay as they were are kept.
+    auto dropped = [this, n_tris](TrianglePair const& p)
+    {
+        return p.b >= n_tris || m_blocks[p.a / kBlockSize].stale || m_blocks[p.b / kBlockSize].stale;
+    };
+    m_pairs.erase(std::remove_if(m_pairs.begin(), m_pairs.end(), dropped), m_pairs.end());
+    BuildStaleBlocks(n_threads);
+
+    // Blocks are few, so their roots are simply tested against each other.
+    std::vector<TrianglePair> block_pairs;
+    for(unsigned a = 0; a < m_blocks.size(); ++a)
+        for(unsigned b = a; b < m_blocks.size(); ++b)
+            if((m_blocks[a].stale || m_blocks[b].stale) && m_blocks[a].Root().Overlaps(m_blocks[b].Root()))
+                block_pairs.push_back({a, b});
+
+    if(n_threads == 0)
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = unsigned(std::min<size_t>(n_threads, block_pairs.size()));
+
+    std::vector<std::vector<TrianglePair>> found(n_threads);
+    std::vector<std::thread> workers;
+    std::atomic<size_t> next{0};
+    for(unsigned i = 0; i < n_threads; ++i)
+        workers.emplace_back(&SelfIntersectionChecker::WalkBlockPairs, this, &block_pairs, &next, &found[i]);
+    for(auto& worker: workers)
+        worker.join();
+
+    for(auto const& pairs: found)
+        m_pairs.insert(m_pairs.end(), pairs.begin(), pairs.end());
+    std::sort(m_pairs.begin(), m_pairs.end(),
+              [](TrianglePair const& x, TrianglePair const& y) {return x.a != y.a ? x.a < y.a : x.b < y.b;});
+    for(auto& block: m_blocks)
+        block.stale = false;
+
+    IntersectionReport report;
+    report.pairs = m_pairs;
+    if(row_size > 0)
+    {
+        for(auto const& pair: report.pairs)
+            for(int k = 0; k < 3; ++k)
+            {
+                report.rows.push_back(indices[3 * pair.a + k] / row_size);
+                report.rows.push_back(indices[3 * pair.b + k] / row_size);
+            }
+        std::sort(report.rows.begin(), report.rows.end());
+        report.rows.erase(std::unique(report.rows.begin(), report.rows.end()), report.rows.end());
+    }
+    m_positions = nullptr;
+    m_indices = nullptr;
+    return report;
+}
@@ -0,0 +1,535 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <cmath>
+#include <cfloat>
+#include <cstdio>
+#include <string>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "revolve.h"
+
+/// Print settings for slicing. Lengths are in millimetres unless noted otherwise.
+struct SliceSettings
+{
+    float scale = 50;              ///< Millimetres per drawing unit.
+    float layer_height = 0.2f;
+    int n_incs = 360;              ///< Points per contour turn.
+    float extrusion_width = 0.45f;
+    float filament_diameter = 1.75f;
+    float print_speed = 40;        ///< mm/s.
+    float travel_speed = 120;      ///< mm/s.
+    glm::vec2 bed_center = glm::vec2(100, 100);
+    unsigned n_threads = 0;        ///< Worker count. 0 picks the hardware concurrency.
+};
+
+/// One printed layer. Points are in millimetres, relative to the axis: x along the normal of the axis in the drawing
+/// plane, y along z.
+struct SliceLayer
+{
+    float z;
+    float h; ///< Height of the cut along the axis from its first point, in drawing units.
+    std::vector<std::vector<glm::vec2>> contours; ///< Closed loops from the inside out, the first point is not repeated.
+    std::vector<bool> holes; ///< Per contour: whether it bounds a hole. Outer boundaries run counterclockwise, holes clockwise.
+};
+
+/// Slices a revolved solid into print layers straight from its profile, without building a mesh.
+///
+/// Profile points are revolved like in RevolveRow, see AxisRow. Layers are planes perpendicular to the line through
+/// the first and last axis point and are printed from its first point towards its last. At n_incs angles the
+/// revolved rows form a grid of points, the vertices of RevolveProfile's solid at that resolution. A layer cuts the
+/// triangles between neighbouring rows and angles like a mesh slicer would, and the cuts are chained into closed
+/// loops. Rows beside a straight axis keep their height all the way around, so their loops have one point per angle;
+/// rows past the ends of the axis or beside a bent part of it are tilted rings, which a layer can also cut between
+/// two angles.
+///
+/// Every profile segment is only visited for the layers it spans, so the work is linear in the profile size plus the
+/// number of contour points written. Layers are cut in parallel.
+class LayerSlicer
+{
+private:
+    std::vector<AxisRow> m_rows;
+
+    /// The rows revolved at n_incs angles.
+    struct Grid
+    {
+        int n_incs;
+        std::vector<float> cos, sin, r;     ///< Per angle.
+        std::vector<float> row_lo, row_hi;  ///< Height range of each row.
+        float h_min, h_max;
+    };
+
+    Grid MakeGrid (int n_incs) const;
+
+    /// Point of row j at angle k as (height, offset along the normal, z), see AxisRow.
+    glm::vec3 Vertex (Grid const& grid, size_t j, int k) const
+    {
+        AxisRow const& rw = m_rows[j];
+        float rr = rw.rho * grid.r[k];
+        return glm::vec3(rw.h + rr * rw.a * grid.cos[k], rw.u + rr * rw.b * grid.cos[k], rr * grid.sin[k]);
+    }
+
+    /// Segments, from row j to row j + 1 (wrapping like the mesh), whose height range spans each layer of height dh.
+    std::vector<std::vector<unsigned>> Spans (Grid const& grid, float dh) const;
+
+    /// Cut the quads of the given segments at height h into closed loops, in millimetres.
+    std::vector<std::vector<glm::vec2>> CutLoops (Grid const& grid, std::vector<unsigned> const& segments, float h, float scale) const;
+
+    static float SignedArea (std::vector<glm::vec2> const& loop);
+
+    /// Even-odd test of p against a closed loop.
+    static bool Contains (std::vector<glm::vec2> const& loop, glm::vec2 p);
+
+    /// Distance from the axis of the farthest point of a loop in each of n directions, starting along x.
+    static std::vector<float> PolarRadii (std::vector<glm::vec2> const& loop, int n);
+
+public:
+    /// \param [in] curve_pos Profile points, treated as closed like in RevolveProfile.
+    /// \param [in] axis_pos Axis points.
+    LayerSlicer (PointView curve_pos, std::vector<glm::vec3> const& axis_pos);
+
+    bool Empty () const {return m_rows.size() < 2;}
+
+    /// Cut the solid into layers with closed contours.
+    std::vector<SliceLayer> Slice (SliceSettings const& settings) const;
+
+    /// Build a "vase mode" path: a single spiral along the outer wall that rises continuously by one layer height
+    /// per turn. Points are (x, y, z) in millimetres, relative to the axis.
+    std::vector<glm::vec3> Spiral (SliceSettings const& settings) const;
+};
+
+inline LayerSlicer::LayerSlicer (PointView curve_pos, std::vector<glm::vec3> const& axis_pos)
+{
+    if(curve_pos.size() < 2 || axis_pos.size() < 2)
+        return;
+    glm::vec3 origin = axis_pos.front();
+    glm::vec3 dir = axis_pos.back() - axis_pos.front();
+    if(glm::length(dir) < 1e-6f)
+        return;
+    dir = glm::normalize(dir);
+    glm::vec3 normal = glm::vec3(-dir.y, dir.x, 0);
+
+    m_rows.reserve(curve_pos.size());
+    for(size_t i = 0; i < curve_pos.size(); ++i)
+        m_rows.push_back(MakeAxisRow(axis_pos, origin, dir, normal, curve_pos[i]));
+}
+
+inline LayerSlicer::Grid LayerSlicer::MakeGrid (int n_incs) const
+{
+    Grid grid;
+    grid.n_incs = n_incs;
+    for(int k = 0; k < n_incs; ++k)
+    {
+        double t = 2 * M_PI * k / n_incs;
+        grid.cos.push_back(float(std::cos(t)));
+        grid.sin.push_back(float(std::sin(t)));
+        grid.r.push_back(float(RevolveRadius(t)));
+    }
+
+    grid.row_lo.resize(m_rows.size());
+    grid.row_hi.resize(m_rows.size());
+    grid.h_min = FLT_MAX;
+    grid.h_max = -FLT_MAX;
+    for(size_t j = 0; j < m_rows.size(); ++j)
+    {
+        float lo = m_rows[j].h, hi = lo;
+        if(m_rows[j].a != 0)
+        {
+            for(int k = 0; k < n_incs; ++k)
+            {
+                float h = Vertex(grid, j, k).x;
+                lo = std::min(lo, h);
+                hi = std::max(hi, h);
+            }
+        }
+        grid.row_lo[j] = lo;
+        grid.row_hi[j] = hi;
+        grid.h_min = std::min(grid.h_min, lo);
+        grid.h_max = std::max(grid.h_max, hi);
+    }
+    return grid;
+}
+
+inline std::vector<std::vector<unsigned>> LayerSlicer::Spans (Grid const& grid, float dh) const
+{
+    std::vector<std::vector<unsigned>> spans(size_t((grid.h_max - grid.h_min) / dh));
+    long n_layers = long(spans.size());
+    for(size_t j = 0; j < m_rows.size(); ++j)
+    {
+        size_t j1 = (j + 1) % m_rows.size();
+        float lo = std::min(grid.row_lo[j], grid.row_lo[j1]), hi = std::max(grid.row_hi[j], grid.row_hi[j1]);
+        if(lo == hi)
+            continue;
+
+        // Layer i is cut at h_min + (i + 0.5) dh. Rounding outwards may add a layer the segment does not cross,
+        // which finds nothing to cut.
+        long first = std::max(0L, long(std::floor((lo - grid.h_min) / dh - 0.5f)));
+        long last = std::min(n_layers - 1, long(std::ceil((hi - grid.h_min) / dh - 0.5f)));
+        for(long i = first; i <= last; ++i)
+            spans[i].push_back(unsigned(j));
+    }
+    return spans;
+}
+
+inline std::vector<std::vector<glm::vec2>> LayerSlicer::CutLoops (Grid const& grid, std::vector<unsigned> const& segments, float h, float scale) const
+{
+    // Crossings are keyed by the mesh edge they lie on: row j from angle k to k + 1, segment j at angle k, or the
+    // diagonal of their quad. Every crossed edge is shared by two triangles, each of which links it to its other
+    // crossed edge, so following the links walks closed loops.
+    const size_t kNone = size_t(-1);
+    int n = grid.n_incs;
+    size_t n_rows = m_rows.size();
+    std::unordered_map<uint64_t, size_t> ids;
+    std::vector<glm::vec2> points;
+    std::vector<std::array<size_t, 2>> links;
+    auto crossing = [&](uint64_t key, glm::vec3 const& p, glm::vec3 const& q)
+    {
+        auto it = ids.find(key);
+        if(it != ids.end())
+            return it->second;
+        float f = (h - p.x) / (q.x - p.x);
+        points.push_back(scale * glm::vec2(p.y + f * (q.y - p.y), p.z + f * (q.z - p.z)));
+        links.push_back({{kNone, kNone}});
+        ids.emplace(key, points.size() - 1);
+        return points.size() - 1;
+    };
+    auto link = [&](size_t a, size_t b)
+    {
+        (links[a][0] == kNone ? links[a][0] : links[a][1]) = b;
+        (links[b][0] == kNone ? links[b][0] : links[b][1]) = a;
+    };
+
+    for(unsigned j: segments)
+    {
+        size_t j1 = (j + 1) % n_rows;
+        bool tilted = m_rows[j].a != 0 || m_rows[j1].a != 0;
+        glm::vec3 c[4];
+        c[0] = Vertex(grid, j, 0);
+        c[3] = Vertex(grid, j1, 0);
+        for(int k = 0; k < n; ++k)
+        {
+            // Corners (j, k), (j, k + 1), (j + 1, k + 1), (j + 1, k).
+            int k1 = (k + 1) % n;
+            c[1] = Vertex(grid, j, k1);
+            c[2] = Vertex(grid, j1, k1);
+            bool above[4];
+            for(int e = 0; e < 4; ++e)
+                above[e] = c[e].x >= h;
+
+            uint64_t row = 3 * (uint64_t(j) * n + k), next_row = 3 * (uint64_t(j1) * n + k);
+            uint64_t column = 3 * (uint64_t(j) * n + k) + 1, next_column = 3 * (uint64_t(j) * n + k1) + 1;
+            if(!tilted)
+            {
+                // Both rows keep their height around the axis, so the layer only crosses the columns, and the cut
+                // of the mesh's diagonal lies on the line between those crossings.
+                if(above[0] != above[3])
+                    link(crossing(column, c[0], c[3]), crossing(next_column, c[1], c[2]));
+            }
+            else
+            {
+                // Cut the two triangles the mesh splits the quad into, see RevolveProfile.
+                struct Edge { int from, to; uint64_t key; };
+                uint64_t diagonal = 3 * (uint64_t(j) * n + k) + 2;
+                Edge triangles[2][3] = {{{0, 1, row}, {1, 3, diagonal}, {3, 0, column}},
+                                        {{2, 3, next_row}, {3, 1, diagonal}, {1, 2, next_column}}};
+                for(auto const& triangle: triangles)
+                {
+                    size_t crossed[2];
+                    int n_crossed = 0;
+                    for(auto const& edge: triangle)
+                        if(above[edge.from] != above[edge.to])
+                            crossed[n_crossed++] = crossing(edge.key, c[edge.from], c[edge.to]);
+                    if(n_crossed == 2)
+                        link(crossed[0], crossed[1]);
+                }
+            }
+            c[0] = c[1];
+            c[3] = c[2];
+        }
+    }
+
+    std::vector<std::vector<glm::vec2>> loops;
+    std::vector<bool> done(points.size(), false);
+    for(size_t start = 0; start < points.size(); ++start)
+    {
+        std::vector<glm::vec2> loop;
+        for(size_t prev = kNone, i = start; i != kNone && !done[i]; )
+        {
+            done[i] = true;
+            loop.push_back(points[i]);
+            size_t next = links[i][0] != prev ? links[i][0] : links[i][1];
+            prev = i;
+            i = next;
+        }
+        if(loop.size() >= 3)
+            loops.push_back(std::move(loop));
+    }
+    return loops;
+}
+
+inline float LayerSlicer::SignedArea (std::vector<glm::vec2> const& loop)
+{
+    float area = 0;
+    for(size_t i = 0; i < loop.size(); ++i)
+    {
+        glm::vec2 p = loop[i], q = loop[(i + 1) % loop.size()];
+        area += p.x * q.y - q.x * p.y;
+    }
+    return 0.5f * area;
+}
+
+inline bool LayerSlicer::Contains (std::vector<glm::vec2> const& loop, glm::vec2 p)
+{
+    bool inside = false;
+    for(size_t i = 0, j = loop.size() - 1; i < loop.size(); j = i++)
+    {
+        glm::vec2 a = loop[i], b = loop[j];
+        if((a.y > p.y) != (b.y > p.y) && p.x < a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y))
+            inside = !inside;
+    }
+    return inside;
+}
+
+inline std::vector<float> LayerSlicer::PolarRadii (std::vector<glm::vec2> const& loop, int n)
+{
+    // Every edge is intersected with the directions within the angle it spans, going the short way around.
+    std::vector<float> radii(n, 0.0f);
+    double step = 2 * M_PI / n;
+    for(size_t i = 0; i < loop.size(); ++i)
+    {
+        glm::vec2 p = loop[i], e = loop[(i + 1) % loop.size()] - p;
+        double from = std::atan2(p.y, p.x), span = std::atan2(p.x * e.y - p.y * e.x, glm::dot(p, p + e));
+        double lo = std::min(from, from + span), hi = std::max(from, from + span);
+        for(long k = long(std::ceil(lo / step)); k <= long(std::floor(hi / step)); ++k)
+        {
+            glm::vec2 d(float(std::cos(k * step)), float(std::sin(k * step)));
+            float cross = d.x * e.y - d.y * e.x;
+            if(cross == 0)
+                continue;
+            int bin = int(((k % n) + n) % n);
+            radii[bin] = std::max(radii[bin], (p.x * e.y - p.y * e.x) / cross);
+        }
+    }
+    return radii;
+}
+
+inline std::vector<SliceLayer> LayerSlicer::Slice (SliceSettings const& settings) const
+{
+    std::vector<SliceLayer> layers;
+    if(Empty())
+        return layers;
+
+    // Layers are cut at their middle height, which is how mesh slicers sample too.
+    float dh = settings.layer_height / settings.scale;
+    Grid grid = MakeGrid(settings.n_incs);
+    auto spans = Spans(grid, dh);
+    size_t n_layers = spans.size();
+    layers.resize(n_layers);
+
+    unsigned n_threads = settings.n_threads;
+    if(n_threads == 0)
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = unsigned(std::max<size_t>(1, std::min<size_t>(n_threads, n_layers)));
+
+    // Threads take every n_threads-th layer, so narrow and wide parts of the vase are spread evenly.
+    auto slice_layers = [&](unsigned first)
+    {
+        for(size_t i = first; i < n_layers; i += n_threads)
+        {
+            SliceLayer& layer = layers[i];
+            layer.z = (i + 1) * settings.layer_height;
+            layer.h = grid.h_min + (i + 0.5f) * dh;
+            auto loops = CutLoops(grid, spans[i], layer.h, settings.scale);
+
+            // A loop inside an odd number of others bounds a hole. Loops go from the inside out, outer boundaries
+            // turned to run counterclockwise and holes clockwise.
+            std::vector<std::pair<int, size_t>> order;
+            for(size_t c = 0; c < loops.size(); ++c)
+            {
+                int depth = 0;
+                for(size_t o = 0; o < loops.size(); ++o)
+                    depth += o != c && Contains(loops[o], loops[c].front());
+                order.push_back(std::make_pair(-depth, c));
+            }
+            std::sort(order.begin(), order.end());
+            for(auto const& entry: order)
+            {
+                std::vector<glm::vec2>& contour = loops[entry.second];
+                bool hole = -entry.first % 2 == 1;
+                if((SignedArea(contour) < 0) != hole)
+                    std::reverse(contour.begin(), contour.end());
+                layer.contours.push_back(std::move(contour));
+                layer.holes.push_back(hole);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for(unsigned i = 0; i < n_threads; ++i)
+        workers.emplace_back(slice_layers, i);
+    for(auto& worker: workers)
+        worker.join();
+    return layers;
+}
+
+inline std::vector<glm::vec3> LayerSlicer::Spiral (SliceSettings const& settings) const
+{
+    std::vector<glm::vec3> path;
+
+    // Distance of the outer wall in every direction in every layer, from the largest loop. A layer without any wall
+    // ends the spiral.
+    std::vector<std::vector<float>> outer;
+    for(auto const& layer: Slice(settings))
+    {
+        if(layer.contours.empty())
+            break;
+        size_t largest = 0;
+        for(size_t c = 1; c < layer.contours.size(); ++c)
+            if(std::fabs(SignedArea(layer.contours[c])) > std::fabs(SignedArea(layer.contours[largest])))
+                largest = c;
+        outer.push_back(PolarRadii(layer.contours[largest], settings.n_incs));
+    }
+
+    // Turn i rises from layer i to layer i + 1, interpolating the wall distance between them.
+    path.reserve(outer.size() * settings.n_incs);
+    for(size_t i = 0; i + 1 < outer.size(); ++i)
+    {
+        for(int k = 0; k < settings.n_incs; ++k)
+        {
+            float f = float(k) / settings.n_incs;
+            double t = 2 * M_PI * f;
+            float rho = outer[i][k] + f * (outer[i + 1][k] - outer[i][k]);
+            path.push_back(glm::vec3(rho * float(std::cos(t)), rho * float(std::sin(t)), (i + 1 + f) * settings.layer_height));
+        }
+    }
+    return path;
+}
+
+/// Write layers as SVG, one group per layer with its height in the slic3r:z attribute, as read by resin printers.
+/// Holes are black polygons of slic3r:type hole, drawn over the white contours around them.
+/// \return false if the file could not be written.
+inline bool WriteSliceSvg (std::string const& path, std::vector<SliceLayer> const& layers)
+{
+    FILE* f = std::fopen(path.c_str(), "w");
+    if(!f)
+        return false;
+
+    float extent = 0;
+    for(auto const& layer: layers)
+        for(auto const& contour: layer.contours)
+            for(auto const& p: contour)
+                extent = std::max(extent, std::max(std::fabs(p.x), std::fabs(p.y)));
+
+    std::fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n");
+    std::fprintf(f, "<svg width=\"%g\" height=\"%g\" xmlns=\"http://www.w3.org/2000/svg\" xmlns:slic3r=\"http://slic3r.org/namespaces/slic3r\">\n", 2 * extent, 2 * extent);
+    for(size_t i = 0; i < layers.size(); ++i)
+    {
+        std::fprintf(f, "  <g id=\"layer%zu\" slic3r:z=\"%g\">\n", i, layers[i].z);
+        // From the outside in, so holes are drawn over the contours around them.
+        for(size_t c = layers[i].contours.size(); c-- > 0; )
+        {
+            bool hole = layers[i].holes[c];
+            std::fprintf(f, "    <polygon slic3r:type=\"%s\" points=\"", hole ? "hole" : "contour");
+            for(auto const& p: layers[i].contours[c])
+                std::fprintf(f, "%.3f,%.3f ", p.x + extent, extent - p.y);
+            std::fprintf(f, "\" style=\"fill: %s\" />\n", hole ? "black" : "white");
+        }
+        std::fprintf(f, "  </g>\n");
+    }
+    std::fprintf(f, "</svg>\n");
+    return std::fclose(f) == 0;
+}
+
+/// Writes G-code moves with absolute extrusion. Printer start and end code (heating, homing) is not included.
+class GcodeWriter
+{
+private:
+    FILE* m_file;
+    SliceSettings const& m_settings;
+    double m_e = 0;
+    double m_e_per_mm;
+    glm::vec3 m_pos;
+
+public:
+    GcodeWriter (std::string const& path, SliceSettings const& settings)
+        : m_file{std::fopen(path.c_str(), "w")}, m_settings{settings}
+    {
+        // Filament length per millimetre of a bead of extrusion width by layer height.
+        double r = settings.filament_diameter / 2;
+        m_e_per_mm = settings.extrusion_width * settings.layer_height / (M_PI * r * r);
+        if(m_file)
+            std::fprintf(m_file, "; Generated by Vasetopia\nG21 ; millimetres\nG90 ; absolute positions\nM82 ; absolute extrusion\nG92 E0\n");
+    }
+    ~GcodeWriter () {Close();}
+    GcodeWriter (GcodeWriter const&) = delete;
+    GcodeWriter& operator= (GcodeWriter const&) = delete;
+
+    bool Good () const {return m_file != nullptr;}
+
+    /// \return false if writing failed.
+    bool Close ()
+    {
+        bool ok = m_file && !std::ferror(m_file);
+        if(m_file)
+            ok = std::fclose(m_file) == 0 && ok;
+        m_file = nullptr;
+        return ok;
+    }
+
+    void Travel (glm::vec3 p)
+    {
+        p += glm::vec3(m_settings.bed_center, 0);
+        std::fprintf(m_file, "G0 F%.0f X%.3f Y%.3f Z%.3f\n", 60 * m_settings.travel_speed, p.x, p.y, p.z);
+        m_pos = p;
+    }
+
+    void Extrude (glm::vec3 p)
+    {
+        p += glm::vec3(m_settings.bed_center, 0);
+        m_e += glm::length(glm::vec2(p) - glm::vec2(m_pos)) * m_e_per_mm;
+        if(p.z != m_pos.z)
+            std::fprintf(m_file, "G1 F%.0f X%.3f Y%.3f Z%.3f E%.5f\n", 60 * m_settings.print_speed, p.x, p.y, p.z, m_e);
+        else
+            std::fprintf(m_file, "G1 X%.3f Y%.3f E%.5f\n", p.x, p.y, m_e);
+        m_pos = p;
+    }
+};
+
+/// Write layers as G-code, printing every contour as a closed loop.
+/// \return false if the file could not be written.
+inline bool WriteSliceGcode (std::string const& path, std::vector<SliceLayer> const& layers, SliceSettings const& settings)
+{
+    GcodeWriter gcode(path, settings);
+    if(!gcode.Good())
+        return false;
+    for(auto const& layer: layers)
+    {
+        for(auto const& contour: layer.contours)
+        {
+            gcode.Travel(glm::vec3(contour.front(), layer.z));
+            for(size_t k = 1; k <= contour.size(); ++k)
+                gcode.Extrude(glm::vec3(contour[k % contour.size()], layer.z));
+        }
+    }
+    return gcode.Close();
+}
+
+/// Write a vase mode spiral as G-code.
+/// \return false if the file could not be written.
+inline bool WriteSpiralGcode (std::string const& path, std::vector<glm::vec3> const& spiral, SliceSettings const& settings)
+{
+    GcodeWriter gcode(path, settings);
+    if(!gcode.Good())
+        return false;
+    if(!spiral.empty())
+    {
+        gcode.Travel(spiral.front());
+        for(size_t k = 1; k < spiral.size(); ++k)
+            gcode.Extrude(spiral[k]);
+    }
+    return gcode.Close();
+}
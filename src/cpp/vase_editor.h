@@ -0,0 +1,363 @@
+#pragma once
+
+#include <iostream>
+#include "events.h"
+#include "custom_shape.h"
+#include "revolve.h"
+#include "profile_picker.h"
+#include "edit_history.h"
+#include "self_intersection.h"
+#include "slicer.h"
+#include "point_file.h"
+
+/// The drawn profile and axis, the solid revolved from them and the event handlers that edit them.
+/// Everything here is driven by the event bus and needs no window, so recorded sessions can be replayed headless.
+class VaseEditor
+{
+public:
+    Curve curve;
+    Curve axis;
+    Mesh mesh;
+    ProfilePicker picker;
+    ProfileRevolver revolver;
+    SelfIntersectionChecker checker;
+    EditHistory history;
+    bool rotate = false; // 3D view.
+    bool solid = false; // Whether the solid was requested. It is then kept up to date with every edit.
+    bool mode = true; // true = draw, false = set axis.
+
+private:
+    struct PlacePointHandler : public EventHandler
+    {
+        Curve& curve;
+        Curve& axis;
+        bool& mode;
+        EditHistory& history;
+
+        PlacePointHandler (Curve& curve_, Curve& axis_, bool& mode_, EditHistory& history_) : curve{curve_}, axis{axis_}, mode{mode_}, history{history_} {}
+        virtual void Handle (std::shared_ptr<Event> e) override
+        {
+            auto ecast = std::static_pointer_cast<LeftClickEvent>(e);
+            auto wpos = ecast->wpos;
+            if(mode)
+                curve.AddPoint(glm::vec3(ecast->wpos, 0));
+            else
+                axis.AddPoint(glm::vec3(ecast->wpos, 0));
+            history.AddPoint(mode ? EditHistory::kCurve : EditHistory::kAxis, glm::vec3(ecast->wpos, 0));
+        }
+    };
+    std::shared_ptr<PlacePointHandler> m_place_point_handler;
+
+    // A finished stroke becomes one undo step.
+    struct CommitHandler : public EventHandler
+    {
+        EditHistory& history;
+
+        CommitHandler (EditHistory& history_) : history{history_} {}
+        virtual void Handle (std::shared_ptr<Event>) override
+        {
+            history.Commit();
+        }
+    };
+    std::shared_ptr<CommitHandler> m_commit_handler;
+
+    struct UndoHandler : public EventHandler
+    {
+        Curve& curve;
+        Curve& axis;
+        EditHistory& history;
+        bool redo;
+
+        UndoHandler (Curve& curve_, Curve& axis_, EditHistory& history_, bool redo_) : curve{curve_}, axis{axis_}, history{history_}, redo{redo_} {}
+        virtual void Handle (std::shared_ptr<Event>) override
+        {
+            if(redo ? !history.CanRedo() : !history.CanUndo())
+                return;
+
+            EditHistory::State before = history.Working();
+            EditHistory::State const& after = redo ? history.Redo() : history.Undo();
+            bool changed = Sync(curve, before.curve, after.curve);
+            changed = Sync(axis, before.axis, after.axis) || changed;
+            if(changed)
+            {
+                std::shared_ptr<ProfileChangedEvent> e{new ProfileChangedEvent};
+                EventBus::Publish(e, EventBus::GetID<ProfileChangedEvent>());
+            }
+        }
+
+        // Bring a curve from one history state to another, only touching the points after their common prefix.
+        static bool Sync (Curve& target, PersistentPoints const& from, PersistentPoints const& to)
+        {
+            size_t keep = from.CommonPrefix(to);
+            if(keep == from.Size() && keep == to.Size())
+                return false;
+            std::vector<glm::vec3> tail;
+            to.CopyTo(keep, &tail);
+            target.Truncate(keep);
+            target.AddPoints(tail);
+            return true;
+        }
+    };
+    std::shared_ptr<UndoHandler> m_undo_handler;
+    std::shared_ptr<UndoHandler> m_redo_handler;
+
+    struct ViewHandler : public EventHandler
+    {
+        VaseEditor& editor;
+        ViewHandler(VaseEditor& editor_) : editor{editor_} {}
+        virtual void Handle (std::shared_ptr<Event>) override
+        {
+            editor.rotate = !editor.rotate;
+        }
+    };
+    std::shared_ptr<ViewHandler> m_view_handler;
+
+    struct ModeHandler : public EventHandler
+    {
+        VaseEditor& editor;
+        ModeHandler(VaseEditor& editor_) : editor{editor_} {}
+        virtual void Handle (std::shared_ptr<Event>) override
+        {
+            editor.mode = !editor.mode;
+        }
+    };
+    std::shared_ptr<ModeHandler> m_mode_handler;
+
+    // Profile and axis to generate from. The history holds them in RAM anyway, so curves kept only on the GPU are
+    // never read back. The profile is viewed in place when its curve keeps it in RAM and copied otherwise.
+    static PointView Profile (Curve const& curve, EditHistory const& history, std::vector<glm::vec3>* storage)
+    {
+        if(curve.GetResidency() == kKeepCpuCopy)
+            return curve.Points(storage);
+        history.Working().curve.CopyTo(0, storage);
+        return PointView(*storage);
+    }
+
+    static std::vector<glm::vec3> Axis (EditHistory const& history)
+    {
+        std::vector<glm::vec3> axis_pos;
+        history.Working().axis.CopyTo(0, &axis_pos);
+        return axis_pos;
+    }
+
+    // Profiles that cross the axis or fold back on themselves produce a self intersecting solid. The check only
+    // redoes the parts of the solid edited since the last one.
+    static IntersectionReport CheckSolid (Mesh const& mesh, SelfIntersectionChecker& checker)
+    {
+        std::vector<glm::vec3> fetched_pos;
+        std::vector<unsigned> fetched_inds;
+        auto const& mesh_inds = mesh.Indices(&fetched_inds);
+        auto report = checker.Check(mesh.Positions(&fetched_pos), mesh_inds, kRevolveIncrements);
+
+        // The blocks take about as much RAM as the solid, which a solid kept only on the GPU should not cost,
+        // so it is checked from scratch every time.
+        if(mesh.GetResidency() == kGpuOnly)
+            checker.Clear();
+        return report;
+    }
+
+    static void WarnSelfIntersections (IntersectionReport const& report)
+    {
+        std::cerr << "Warning: the solid has " << report.pairs.size() << " intersecting triangle pairs at profile rows:";
+        for(unsigned row: report.rows)
+            std::cerr << ' ' << row;
+        std::cerr << std::endl;
+    }
+
+    struct RotateHandler : public EventHandler
+    {
+        Curve& curve;
+        Curve& axis;
+        Mesh& mesh;
+        ProfilePicker& picker;
+        ProfileRevolver& revolver;
+        SelfIntersectionChecker& checker;
+        EditHistory const& history;
+        bool& solid;
+        bool only_if_generated; // Update a requested solid after an edit instead of generating on request.
+
+        RotateHandler (Curve& curve_, Curve& axis_, Mesh& mesh_, ProfilePicker& picker_, ProfileRevolver& revolver_,
+                       SelfIntersectionChecker& checker_, EditHistory const& history_, bool& solid_, bool only_if_generated_) 
+            : curve{curve_}, axis{axis_}, mesh{mesh_}, picker{picker_}, revolver{revolver_}, checker{checker_}, history{history_}, solid{solid_}, only_if_generated{only_if_generated_} {}
+        virtual void Handle (std::shared_ptr<Event> e) override 
+        {
+            // The mesh is cleared while there is no axis, so it cannot tell whether the solid was requested: undoing
+            // the axis and redoing it brings the solid back.
+            if(only_if_generated && !solid)
+                return;
+            solid = true;
+            if(axis.Size() < 2)
+            {
+                mesh.Clear();
+                picker.Clear();
+                revolver.Clear();
+                checker.Clear();
+                return;
+            }
+
+            // Rotate curve positions around Y axis. Only rows that changed since the last call are recomputed and
+            // uploaded.
+            std::vector<glm::vec3> axis_pos = Axis(history);
+            int n_incs = kRevolveIncrements;
+            RevolveUpdate update;
+            revolver.Revolve(history.Working().curve, axis_pos, n_incs, &update);
+
+            // Triangles of a row reach to the next one, so they change with either row. Only those are checked
+            // again below.
+            size_t n_rows = update.n_rows, row_tris = 2 * n_incs, first = 0;
+            mesh.Resize(n_rows * n_incs, 3 * n_rows * row_tris);
+            for(auto const& range: update.ranges)
+            {
+                size_t n = (range.end - range.first) * n_incs;
+                mesh.SetVertices(range.first * n_incs, &update.positions[first], &update.normals[first], &update.uvs[first], n);
+                first += n;
+                checker.Invalidate(range.first > 0 ? (range.first - 1) * row_tris : 0, range.end * row_tris);
+                if(range.first == 0)
+                    checker.Invalidate((n_rows - 1) * row_tris, n_rows * row_tris);
+            }
+            mesh.SetIndices(3 * update.first_index_row * row_tris, update.indices.data(), update.indices.size());
+            checker.Invalidate(update.first_index_row * row_tris, n_rows * row_tris);
+            std::vector<glm::vec3> copied;
+            picker.Update(Profile(curve, history, &copied), axis_pos, n_incs, update.first_moved);
+
+            auto report = CheckSolid(mesh, checker);
+            if(!report.Empty())
+                WarnSelfIntersections(report);
+        }
+    };
+    std::shared_ptr<RotateHandler> m_rotate_handler;
+    std::shared_ptr<RotateHandler> m_regenerate_handler;
+
+    // The solid is checked after every generation, this checks it again on request and also reports a clean one.
+    struct CheckHandler : public EventHandler
+    {
+        Mesh& mesh;
+        SelfIntersectionChecker& checker;
+
+        CheckHandler (Mesh& mesh_, SelfIntersectionChecker& checker_) : mesh{mesh_}, checker{checker_} {}
+        virtual void Handle (std::shared_ptr<Event>) override
+        {
+            if(mesh.Empty())
+            {
+                std::cerr << "Nothing to check, revolve the profile first" << std::endl;
+                return;
+            }
+
+            auto report = CheckSolid(mesh, checker);
+            if(report.Empty())
+                std::cout << "The solid does not intersect itself" << std::endl;
+            else
+                WarnSelfIntersections(report);
+        }
+    };
+    std::shared_ptr<CheckHandler> m_check_handler;
+
+    // Slice the solid for printing, straight from the profile.
+    struct SliceHandler : public EventHandler
+    {
+        Curve& curve;
+        EditHistory const& history;
+        bool spiral; // Write a vase mode spiral instead of layer contours.
+
+        SliceHandler (Curve& curve_, EditHistory const& history_, bool spiral_) : curve{curve_}, history{history_}, spiral{spiral_} {}
+        virtual void Handle (std::shared_ptr<Event>) override
+        {
+            std::vector<glm::vec3> copied;
+            LayerSlicer slicer(Profile(curve, history, &copied), Axis(history));
+            if(slicer.Empty())
+            {
+                std::cerr << "Nothing to slice, draw a profile and an axis first" << std::endl;
+                return;
+            }
+
+            SliceSettings settings;
+            bool ok;
+            if(spiral)
+                ok = WriteSpiralGcode("vase_spiral.gcode", slicer.Spiral(settings), settings);
+            else
+            {
+                auto layers = slicer.Slice(settings);
+                ok = WriteSliceGcode("vase.gcode", layers, settings) && WriteSliceSvg("vase.svg", layers);
+            }
+            if(ok)
+                std::cout << "Wrote " << (spiral ? "vase_spiral.gcode" : "vase.gcode and vase.svg") << std::endl;
+            else
+                std::cerr << "Could not write the sliced vase" << std::endl;
+        }
+    };
+    std::shared_ptr<SliceHandler> m_slice_handler;
+    std::shared_ptr<SliceHandler> m_spiral_handler;
+
+public:
+    VaseEditor ()
+        : m_place_point_handler{new PlacePointHandler(curve, axis, mode, history)},
+          m_commit_handler{new CommitHandler(history)},
+          m_undo_handler{new UndoHandler(curve, axis, history, false)},
+          m_redo_handler{new UndoHandler(curve, axis, history, true)},
+          m_view_handler{new ViewHandler(*this)},
+          m_mode_handler{new ModeHandler(*this)},
+          m_rotate_handler{new RotateHandler(curve, axis, mesh, picker, revolver, checker, history, solid, false)},
+          m_regenerate_handler{new RotateHandler(curve, axis, mesh, picker, revolver, checker, history, solid, true)},
+          m_check_handler{new CheckHandler(mesh, checker)},
+          m_slice_handler{new SliceHandler(curve, history, false)},
+          m_spiral_handler{new SliceHandler(curve, history, true)}
+    {
+        EventBus::Subscribe(EventBus::GetID<LeftClickEvent>(), m_place_point_handler);
+        EventBus::Subscribe(EventBus::GetID<RightClickEvent>(), m_place_point_handler);
+        EventBus::Subscribe(EventBus::GetID<RButtonEvent>(), m_rotate_handler);
+        EventBus::Subscribe(EventBus::GetID<PButtonEvent>(), m_view_handler);
+        EventBus::Subscribe(EventBus::GetID<KButtonEvent>(), m_mode_handler);
+        EventBus::Subscribe(EventBus::GetID<StrokeEndEvent>(), m_commit_handler);
+        EventBus::Subscribe(EventBus::GetID<UndoEvent>(), m_undo_handler);
+        EventBus::Subscribe(EventBus::GetID<RedoEvent>(), m_redo_handler);
+        EventBus::Subscribe(EventBus::GetID<ProfileChangedEvent>(), m_regenerate_handler);
+        EventBus::Subscribe(EventBus::GetID<IntersectionCheckEvent>(), m_check_handler);
+        EventBus::Subscribe(EventBus::GetID<SliceEvent>(), m_slice_handler);
+        EventBus::Subscribe(EventBus::GetID<SpiralSliceEvent>(), m_spiral_handler);
+    }
+
+    /// Replace the profile and axis, e.g. with the columns of a mapped point file, as one undo step.
+    /// If an owner that keeps the points alive is given, the curves and the history refer to them in place instead of
+    /// copying them; a solid that was requested is updated.
+    void Load (PointView profile, PointView axis_pos, std::shared_ptr<void const> owner = nullptr)
+    {
+        curve.SetPositions(profile, owner);
+        axis.SetPositions(axis_pos, owner);
+        history.Set(EditHistory::kCurve, owner ? PersistentPoints(profile, owner) : PersistentPoints(profile));
+        history.Set(EditHistory::kAxis, owner ? PersistentPoints(axis_pos, owner) : PersistentPoints(axis_pos));
+        history.Commit();
+        std::shared_ptr<ProfileChangedEvent> e{new ProfileChangedEvent};
+        EventBus::Publish(e, EventBus::GetID<ProfileChangedEvent>());
+    }
+
+    /// Load the profile and axis from a point file. The file stays mapped while the curves or the history refer to it.
+    bool Load (std::string const& path)
+    {
+        std::shared_ptr<MappedPointFile> file = std::make_shared<MappedPointFile>(path);
+        if(!file->Good())
+            return false;
+        Load(file->Profile(), file->Axis(), file);
+        return true;
+    }
+
+    /// Choose whether the curves and the solid keep their data in RAM after it is uploaded.
+    void SetResidency (Residency residency)
+    {
+        curve.SetResidency(residency);
+        axis.SetResidency(residency);
+        mesh.SetResidency(residency);
+    }
+
+    /// Memory taken by the curves, the solid, the undo history, the picker's index, the self intersection check and
+    /// the profile points kept by the revolver.
+    MemoryUsage Memory () const
+    {
+        MemoryUsage usage = curve.Memory();
+        usage += axis.Memory();
+        usage += mesh.Memory();
+        // The revolver's profile shares its nodes with the history.
+        std::unordered_set<void const*> seen;
+        usage.cpu_bytes += history.Bytes(&seen) + revolver.Bytes(&seen) + picker.Bytes() + checker.Bytes();
+        return usage;
+    }
+};